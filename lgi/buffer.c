@@ -11,19 +11,219 @@
 #include <string.h>
 #include "lgi.h"
 
+typedef enum _BufferStore
+{
+  /* Buffer owns its data, which are allocated by g_malloc and can be
+     resized. */
+  BUFFER_STORE_OWNED,
+
+  /* Buffer is a view into the data of another buffer, which is kept
+     alive in the registry, keyed by the address of the view. */
+  BUFFER_STORE_VIEW,
+
+  /* Buffer points to foreign data owned by some other entity, which
+     is referenced by the buffer and released by destroy notification
+     when the buffer is collected, or which is Lua value kept alive in
+     the registry, keyed by the address of the buffer. */
+  BUFFER_STORE_FOREIGN,
+
+  /* Buffer points to the data of GByteArray, which is referenced by
+     the buffer.  C code can reallocate or resize the array, so data
+     and size are refreshed from the array on every access. */
+  BUFFER_STORE_BYTE_ARRAY,
+} BufferStore;
+
+typedef struct _Buffer
+{
+  /* Pointer to the data, unused for views. */
+  guint8 *data;
+
+  /* Size of the buffer data. */
+  gsize size;
+
+  /* Allocated size of owned data, or size of adopted foreign data,
+     accounted to the garbage collector. */
+  gsize allocated;
+
+  /* Buffer holding the data of the view and offset of the view in
+     it.  Parent is never a view itself. */
+  struct _Buffer *parent;
+  gsize offset;
+
+  /* Owner of foreign data and its destroy notification. */
+  gpointer owner;
+  GDestroyNotify destroy;
+
+  /* Type of the data storage. */
+  BufferStore store;
+
+  /* Set when the data must not be modified. */
+  gboolean readonly;
+} Buffer;
+
+/* lightuserdata key to cache table containing
+   borrowedbuffer(weak) -> owner */
+static int borrowed_cache;
+
+/* lightuserdata key to cache table containing
+   owner(weak) -> { borrowedbuffer(weak) -> true }, sets of buffers
+   borrowed from the owner. */
+static int borrowers_cache;
+
+/* Refreshes data and size of the buffer over GByteArray. */
+static Buffer *
+buffer_refresh (Buffer *buffer)
+{
+  if (buffer->store == BUFFER_STORE_BYTE_ARRAY && buffer->owner != NULL)
+    {
+      GByteArray *array = buffer->owner;
+      buffer->data = array->data;
+      buffer->size = array->len;
+    }
+  return buffer;
+}
+
+/* Returns pointer to the data of the buffer.  Views are resolved
+   through their parent, because the parent might have been resized
+   in the meantime. */
+static guint8 *
+buffer_data (lua_State *L, Buffer *buffer)
+{
+  /* Empty buffers might have no data allocated at all.  Point them
+     to empty zero-terminated storage instead, so that the data of
+     any buffer are non-NULL and readable as empty string. */
+  static guint8 empty[1];
+
+  if (buffer->store != BUFFER_STORE_VIEW)
+    return buffer->data != NULL ? buffer->data : empty;
+
+  if (buffer->offset + buffer->size > buffer_refresh (buffer->parent)->size)
+    luaL_error (L, "bytes: view exceeds its buffer");
+  return buffer_data (L, buffer->parent) + buffer->offset;
+}
+
+/* Returns pointer to the data of the buffer, for modification. */
+static guint8 *
+buffer_writable_data (lua_State *L, Buffer *buffer)
+{
+  if ((buffer->store == BUFFER_STORE_VIEW ? buffer->parent : buffer)
+      ->readonly)
+    luaL_error (L, "bytes: buffer is read-only");
+  return buffer_data (L, buffer);
+}
+
+static Buffer *
+buffer_check (lua_State *L, int narg)
+{
+  return buffer_refresh (luaL_checkudata (L, narg, LGI_BYTES_BUFFER));
+}
+
+gpointer
+lgi_buffer_test (lua_State *L, int narg, gsize *size)
+{
+  Buffer *buffer = lgi_udata_test (L, narg, LGI_BYTES_BUFFER);
+  if (buffer == NULL)
+    return NULL;
+
+  buffer_refresh (buffer);
+  if (size)
+    *size = buffer->size;
+  return buffer_data (L, buffer);
+}
+
+gpointer
+lgi_buffer_test_writable (lua_State *L, int narg, gsize *size)
+{
+  Buffer *buffer = lgi_udata_test (L, narg, LGI_BYTES_BUFFER);
+  if (buffer == NULL)
+    return NULL;
+
+  buffer_refresh (buffer);
+  if (size)
+    *size = buffer->size;
+  return buffer_writable_data (L, buffer);
+}
+
+/* Creates new buffer userdata on the stack, uninitialized. */
+static Buffer *
+buffer_create (lua_State *L, BufferStore store)
+{
+  Buffer *buffer = lua_newuserdata (L, sizeof (Buffer));
+  memset (buffer, 0, sizeof (Buffer));
+  buffer->store = store;
+  luaL_getmetatable (L, LGI_BYTES_BUFFER);
+  lua_setmetatable (L, -2);
+  return buffer;
+}
+
+/* Gets data of string or buffer at narg, or NULL if narg is neither
+   of them. */
+static const guint8 *
+buffer_source (lua_State *L, int narg, gsize *size)
+{
+  const guint8 *data = lgi_buffer_test (L, narg, size);
+  if (data == NULL && lua_type (L, narg) == LUA_TSTRING)
+    data = (const guint8 *) lua_tolstring (L, narg, size);
+  return data;
+}
+
+/* Checks range specified by 1-based position at narg and length at
+   narg + 1 (defaulting to the rest of the buffer), and returns its
+   0-based offset and length. */
+static void
+buffer_range (lua_State *L, Buffer *buffer, int narg,
+	      gsize *offset, gsize *length)
+{
+  lua_Integer pos = luaL_optinteger (L, narg, 1);
+  luaL_argcheck (L, pos > 0 && (gsize) pos <= buffer->size + 1,
+		 narg, "bad position");
+  *offset = pos - 1;
+  if (lua_isnoneornil (L, narg + 1))
+    *length = buffer->size - *offset;
+  else
+    {
+      lua_Integer len = luaL_checkinteger (L, narg + 1);
+      luaL_argcheck (L, len >= 0 && (gsize) len <= buffer->size - *offset,
+		     narg + 1, "bad length");
+      *length = len;
+    }
+}
+
+/* Changes the size of owned buffer data, newly added part is zeroed. */
+static void
+buffer_resize (lua_State *L, Buffer *buffer, gsize size)
+{
+  if (buffer->store != BUFFER_STORE_OWNED)
+    luaL_error (L, "bytes: only owned buffers can be resized");
+
+  if (size > buffer->allocated || size < buffer->allocated / 4)
+    {
+      /* Reallocate storage, leaving some space for subsequent
+	 growth. */
+      gsize allocated = size > buffer->allocated
+	? MAX (size, buffer->allocated * 2) : size;
+      buffer->data = g_realloc (buffer->data, allocated);
+      lgi_memory_remove (L, buffer->allocated);
+      lgi_memory_add (L, allocated);
+      buffer->allocated = allocated;
+    }
+  if (size > buffer->size)
+    memset (buffer->data + buffer->size, 0, size - buffer->size);
+  buffer->size = size;
+}
+
 static int
 buffer_len (lua_State *L)
 {
-  luaL_checkudata (L, 1, LGI_BYTES_BUFFER);
-  lua_pushinteger (L, lua_objlen (L, 1));
+  lua_pushinteger (L, buffer_check (L, 1)->size);
   return 1;
 }
 
 static int
 buffer_tostring (lua_State *L)
 {
-  gpointer data = luaL_checkudata (L, 1, LGI_BYTES_BUFFER);
-  lua_pushlstring (L, data, lua_objlen (L, 1));
+  Buffer *buffer = buffer_check (L, 1);
+  lua_pushlstring (L, (const char *) buffer_data (L, buffer), buffer->size);
   return 1;
 }
 
@@ -31,10 +231,18 @@ static int
 buffer_index (lua_State *L)
 {
   lgi_Unsigned index;
-  unsigned char *buffer = luaL_checkudata (L, 1, LGI_BYTES_BUFFER);
+  Buffer *buffer = buffer_check (L, 1);
+  if (lua_type (L, 2) == LUA_TSTRING)
+    {
+      /* Look up the method. */
+      lua_pushvalue (L, 2);
+      lua_rawget (L, lua_upvalueindex (1));
+      return 1;
+    }
+
   index = lua_tointeger (L, 2);
-  if (index > 0 && (size_t) index <= lua_objlen (L, 1))
-    lua_pushinteger (L, buffer[index - 1]);
+  if (index > 0 && (size_t) index <= buffer->size)
+    lua_pushinteger (L, buffer_data (L, buffer)[index - 1]);
   else
     {
       luaL_argcheck (L, !lua_isnoneornil (L, 2), 2, "nil index");
@@ -47,54 +255,579 @@ static int
 buffer_newindex (lua_State *L)
 {
   lgi_Unsigned index;
-  unsigned char *buffer = luaL_checkudata (L, 1, LGI_BYTES_BUFFER);
+  Buffer *buffer = buffer_check (L, 1);
   index = luaL_checkint (L, 2);
-  luaL_argcheck (L, index > 0 && (size_t) index <= lua_objlen (L, 1),
+  luaL_argcheck (L, index > 0 && (size_t) index <= buffer->size,
                  2, "bad index");
-  buffer[index - 1] = luaL_checkint (L, 3) & 0xff;
+  buffer_writable_data (L, buffer)[index - 1] = luaL_checkint (L, 3) & 0xff;
+  return 0;
+}
+
+static int
+buffer_gc (lua_State *L)
+{
+  Buffer *buffer = buffer_check (L, 1);
+  if (buffer->store == BUFFER_STORE_OWNED)
+    {
+      lgi_memory_remove (L, buffer->allocated);
+      g_free (buffer->data);
+    }
+  else if (buffer->store == BUFFER_STORE_FOREIGN
+	   || buffer->store == BUFFER_STORE_BYTE_ARRAY)
+    {
+      lgi_memory_remove (L, buffer->allocated);
+      if (buffer->destroy)
+	buffer->destroy (buffer->owner);
+    }
+
+  if (buffer->store != BUFFER_STORE_OWNED)
+    {
+      /* Free the reference to the parent or owner. */
+      lua_pushlightuserdata (L, buffer);
+      lua_pushnil (L);
+      lua_rawset (L, LUA_REGISTRYINDEX);
+    }
+
+  buffer->data = buffer->owner = NULL;
+  buffer->size = buffer->allocated = 0;
   return 0;
 }
 
 static const luaL_Reg buffer_mt_reg[] = {
   { "__len", buffer_len },
   { "__tostring", buffer_tostring },
-  { "__index", buffer_index },
   { "__newindex", buffer_newindex },
+  { "__gc", buffer_gc },
   { NULL, NULL }
 };
 
+/* Creates view sharing the data of the buffer.  Lua-side prototype:
+   view = buffer:view([pos [, length]]) */
+static int
+buffer_view (lua_State *L)
+{
+  Buffer *buffer = buffer_check (L, 1), *view;
+  gsize offset, length;
+  buffer_range (L, buffer, 2, &offset, &length);
+  view = buffer_create (L, BUFFER_STORE_VIEW);
+  view->size = length;
+  if (buffer->store == BUFFER_STORE_VIEW)
+    {
+      /* Views of views refer directly to the root buffer. */
+      view->parent = buffer->parent;
+      view->offset = buffer->offset + offset;
+    }
+  else
+    {
+      view->parent = buffer;
+      view->offset = offset;
+    }
+
+  /* Keep the parent alive while the view exists. */
+  lua_pushlightuserdata (L, view);
+  if (buffer->store == BUFFER_STORE_VIEW)
+    {
+      lua_pushlightuserdata (L, buffer);
+      lua_rawget (L, LUA_REGISTRYINDEX);
+    }
+  else
+    lua_pushvalue (L, 1);
+  lua_rawset (L, LUA_REGISTRYINDEX);
+  return 1;
+}
+
+/* Fills range of the buffer with given byte.  Lua-side prototype:
+   buffer:fill(byte [, pos [, length]]) */
+static int
+buffer_fill (lua_State *L)
+{
+  Buffer *buffer = buffer_check (L, 1);
+  int byte = luaL_checkint (L, 2);
+  gsize offset, length;
+  buffer_range (L, buffer, 3, &offset, &length);
+  memset (buffer_writable_data (L, buffer) + offset, byte & 0xff, length);
+  return 0;
+}
+
+/* Copies contents of string or buffer into the buffer, source and
+   target may overlap.  Lua-side prototype:
+   buffer:copy(pos, source [, srcpos [, length]]) */
+static int
+buffer_copy (lua_State *L)
+{
+  Buffer *buffer = buffer_check (L, 1);
+  lua_Integer pos = luaL_checkinteger (L, 2), srcpos;
+  const guint8 *source;
+  gsize size, length;
+
+  source = buffer_source (L, 3, &size);
+  if (source == NULL)
+    return luaL_argerror (L, 3, "string or bytes expected");
+  srcpos = luaL_optinteger (L, 4, 1);
+  luaL_argcheck (L, srcpos > 0 && (gsize) srcpos <= size + 1, 4,
+		 "bad position");
+  length = luaL_optinteger (L, 5, size - (srcpos - 1));
+  luaL_argcheck (L, length <= size - (srcpos - 1), 5, "bad length");
+  luaL_argcheck (L, pos > 0 && (gsize) pos <= buffer->size + 1
+		 && length <= buffer->size - (pos - 1), 2, "bad position");
+  memmove (buffer_writable_data (L, buffer) + pos - 1, source + srcpos - 1,
+	   length);
+  return 0;
+}
+
+/* Finds byte or byte sequence (string or buffer) in the buffer.
+   Returns 1-based position of the first occurence or nil.  Lua-side
+   prototype:
+   pos = buffer:find(needle [, init]) */
+static int
+buffer_find (lua_State *L)
+{
+  Buffer *buffer = buffer_check (L, 1);
+  const guint8 *data = buffer_data (L, buffer), *needle, *found, *end;
+  lua_Integer init = luaL_optinteger (L, 3, 1);
+  guint8 byte;
+  gsize size;
+
+  luaL_argcheck (L, init > 0, 3, "bad position");
+  if (lua_type (L, 2) == LUA_TNUMBER)
+    {
+      byte = lua_tointeger (L, 2) & 0xff;
+      needle = &byte;
+      size = 1;
+    }
+  else
+    {
+      needle = buffer_source (L, 2, &size);
+      if (needle == NULL)
+	return luaL_argerror (L, 2, "number, string or bytes expected");
+    }
+
+  if ((gsize) init - 1 + size <= buffer->size)
+    {
+      /* Scan for the first byte of the needle, compare the rest
+	 at the candidate positions only. */
+      end = data + buffer->size - size + 1;
+      for (data += init - 1; data < end; data = found + 1)
+	{
+	  if (size == 0)
+	    found = data;
+	  else
+	    found = memchr (data, needle[0], end - data);
+	  if (found == NULL)
+	    break;
+	  if (size == 0 || memcmp (found + 1, needle + 1, size - 1) == 0)
+	    {
+	      lua_pushinteger (L, found - buffer_data (L, buffer) + 1);
+	      return 1;
+	    }
+	}
+    }
+
+  lua_pushnil (L);
+  return 1;
+}
+
+/* Changes size of the buffer.  Lua-side prototype:
+   buffer:resize(size) */
+static int
+buffer_resize_method (lua_State *L)
+{
+  Buffer *buffer = buffer_check (L, 1);
+  lua_Integer size = luaL_checkinteger (L, 2);
+  luaL_argcheck (L, size >= 0, 2, "bad size");
+  buffer_resize (L, buffer, size);
+  return 0;
+}
+
+/* Appends byte, string or buffer at the end of the buffer.  Lua-side
+   prototype:
+   buffer:append(data) */
+static int
+buffer_append (lua_State *L)
+{
+  Buffer *buffer = buffer_check (L, 1);
+  gsize pos = buffer->size, size;
+  if (lua_type (L, 2) == LUA_TNUMBER)
+    {
+      buffer_resize (L, buffer, pos + 1);
+      buffer->data[pos] = lua_tointeger (L, 2) & 0xff;
+    }
+  else
+    {
+      if (buffer_source (L, 2, &size) == NULL)
+	return luaL_argerror (L, 2, "number, string or bytes expected");
+
+      /* Source is retrieved again after the resize, because it can
+	 be the buffer itself or its view. */
+      buffer_resize (L, buffer, pos + size);
+      memcpy (buffer_data (L, buffer) + pos, buffer_source (L, 2, &size),
+	      size);
+    }
+  return 0;
+}
+
+/* Types of typed accessors, in the order of buffer_types table. */
+typedef enum _BufferType
+{
+  BUFFER_TYPE_INT8, BUFFER_TYPE_UINT8, BUFFER_TYPE_INT16,
+  BUFFER_TYPE_UINT16, BUFFER_TYPE_INT32, BUFFER_TYPE_UINT32,
+  BUFFER_TYPE_INT64, BUFFER_TYPE_UINT64, BUFFER_TYPE_FLOAT,
+  BUFFER_TYPE_DOUBLE
+} BufferType;
+
+static const struct
+{
+  const char *name;
+  gsize width;
+} buffer_types[] = {
+  { "int8", 1 }, { "uint8", 1 }, { "int16", 2 }, { "uint16", 2 },
+  { "int32", 4 }, { "uint32", 4 }, { "int64", 8 }, { "uint64", 8 },
+  { "float", 4 }, { "double", 8 },
+};
+
+/* Byte orders of the typed accessors, encoded together with the type
+   into the upvalue of the accessor. */
+enum { BUFFER_ORDER_NATIVE, BUFFER_ORDER_LE, BUFFER_ORDER_BE };
+static const char *const buffer_orders[] = { "", "_le", "_be" };
+
+/* Checks position of typed value and returns its address. */
+static guint8 *
+buffer_typed_address (lua_State *L, BufferType type, gboolean write)
+{
+  Buffer *buffer = buffer_check (L, 1);
+  lua_Integer pos = luaL_checkinteger (L, 2);
+  luaL_argcheck (L, pos > 0 && buffer_types[type].width <= buffer->size
+		 && (gsize) pos - 1 <= buffer->size - buffer_types[type].width,
+		 2, "bad position");
+  return (write ? buffer_writable_data (L, buffer)
+	  : buffer_data (L, buffer)) + pos - 1;
+}
+
+/* Converts value between native and requested byte order. */
+static guint64
+buffer_typed_swap (guint64 value, gsize width, int order)
+{
+  if (order == BUFFER_ORDER_NATIVE
+      || (order == BUFFER_ORDER_LE) == (G_BYTE_ORDER == G_LITTLE_ENDIAN))
+    return value;
+
+  switch (width)
+    {
+    case 2:
+      return GUINT16_SWAP_LE_BE ((guint16) value);
+    case 4:
+      return GUINT32_SWAP_LE_BE ((guint32) value);
+    case 8:
+      return GUINT64_SWAP_LE_BE (value);
+    default:
+      return value;
+    }
+}
+
+/* Reads typed value from the buffer.  Lua-side prototype:
+   value = buffer:get_<type>[_le|_be](pos) */
+static int
+buffer_get_typed (lua_State *L)
+{
+  int code = lua_tointeger (L, lua_upvalueindex (1));
+  BufferType type = code / 3;
+  gsize width = buffer_types[type].width;
+  union { guint8 u8; guint16 u16; guint32 u32; guint64 u64;
+    gfloat f; gdouble d; } val;
+  guint64 value = 0;
+
+  memcpy (&val, buffer_typed_address (L, type, FALSE), width);
+  switch (width)
+    {
+    case 1: value = val.u8; break;
+    case 2: value = val.u16; break;
+    case 4: value = val.u32; break;
+    case 8: value = val.u64; break;
+    }
+  value = buffer_typed_swap (value, width, code % 3);
+
+  switch (type)
+    {
+#if LUA_VERSION_NUM >= 503
+#define PUSH(v) lua_pushinteger (L, (lua_Integer) (v))
+#else
+#define PUSH(v) lua_pushnumber (L, (lua_Number) (v))
+#endif
+    case BUFFER_TYPE_INT8: PUSH ((gint8) value); break;
+    case BUFFER_TYPE_INT16: PUSH ((gint16) value); break;
+    case BUFFER_TYPE_INT32: PUSH ((gint32) value); break;
+    case BUFFER_TYPE_INT64: PUSH ((gint64) value); break;
+#undef PUSH
+    case BUFFER_TYPE_UINT8:
+    case BUFFER_TYPE_UINT16:
+    case BUFFER_TYPE_UINT32:
+      lua_pushinteger (L, (lua_Integer) value);
+      break;
+    case BUFFER_TYPE_UINT64:
+#if LUA_VERSION_NUM >= 503
+      lua_pushinteger (L, (lua_Integer) value);
+#else
+      lua_pushnumber (L, (lua_Number) value);
+#endif
+      break;
+    case BUFFER_TYPE_FLOAT:
+      val.u32 = value;
+      lua_pushnumber (L, val.f);
+      break;
+    case BUFFER_TYPE_DOUBLE:
+      val.u64 = value;
+      lua_pushnumber (L, val.d);
+      break;
+    }
+  return 1;
+}
+
+/* Writes typed value into the buffer.  Lua-side prototype:
+   buffer:set_<type>[_le|_be](pos, value) */
+static int
+buffer_set_typed (lua_State *L)
+{
+  int code = lua_tointeger (L, lua_upvalueindex (1));
+  BufferType type = code / 3;
+  gsize width = buffer_types[type].width;
+  guint8 *address = buffer_typed_address (L, type, TRUE);
+  union { guint8 u8; guint16 u16; guint32 u32; guint64 u64;
+    gfloat f; gdouble d; } val;
+  guint64 value;
+
+  if (type == BUFFER_TYPE_FLOAT)
+    {
+      val.f = (gfloat) luaL_checknumber (L, 3);
+      value = val.u32;
+    }
+  else if (type == BUFFER_TYPE_DOUBLE)
+    {
+      val.d = luaL_checknumber (L, 3);
+      value = val.u64;
+    }
+#if LUA_VERSION_NUM >= 503
+  else if (lua_isinteger (L, 3))
+    value = (guint64) lua_tointeger (L, 3);
+#endif
+  else
+    {
+      lua_Number number = luaL_checknumber (L, 3);
+      value = number < 0 ? (guint64) (gint64) number : (guint64) number;
+    }
+
+  value = buffer_typed_swap (value, width, code % 3);
+  switch (width)
+    {
+    case 1: val.u8 = value; break;
+    case 2: val.u16 = value; break;
+    case 4: val.u32 = value; break;
+    case 8: val.u64 = value; break;
+    }
+  memcpy (address, &val, width);
+  return 0;
+}
+
+static const luaL_Reg buffer_methods_reg[] = {
+  { "view", buffer_view },
+  { "fill", buffer_fill },
+  { "copy", buffer_copy },
+  { "find", buffer_find },
+  { "resize", buffer_resize_method },
+  { "append", buffer_append },
+  { NULL, NULL }
+};
+
+/* Creates new buffer, either of specified size filled with zeros or
+   with the copy of the specified string.  Lua-side prototype:
+   buffer = bytes.new(size|string) */
 static int
 buffer_new (lua_State *L)
 {
-  size_t size;
-  gpointer *buffer;
+  gsize size;
+  Buffer *buffer;
   const char *source = NULL;
 
   if (lua_type (L, 1) == LUA_TSTRING)
     source = lua_tolstring (L, 1, &size);
   else
-    size = luaL_checkint (L, 1);
-  buffer = lua_newuserdata (L, size);
+    {
+      lua_Integer len = luaL_checkinteger (L, 1);
+      luaL_argcheck (L, len >= 0, 1, "bad size");
+      size = len;
+    }
+  buffer = buffer_create (L, BUFFER_STORE_OWNED);
+  buffer_resize (L, buffer, size);
   if (source)
-    memcpy (buffer, source, size);
-  else
-    memset (buffer, 0, size);
-  luaL_getmetatable (L, LGI_BYTES_BUFFER);
-  lua_setmetatable (L, -2);
+    memcpy (buffer_data (L, buffer), source, size);
   return 1;
 }
 
+void
+lgi_buffer_new_foreign (lua_State *L, gpointer data, gsize size,
+			gpointer owner, GDestroyNotify destroy,
+			gboolean writable, gsize memsize)
+{
+  Buffer *buffer = buffer_create (L, BUFFER_STORE_FOREIGN);
+  buffer->data = data;
+  buffer->size = size;
+  buffer->owner = owner;
+  buffer->destroy = destroy;
+  buffer->readonly = !writable;
+  buffer->allocated = memsize;
+  lgi_memory_add (L, memsize);
+}
+
+void
+lgi_buffer_new_borrowed (lua_State *L, gpointer data, gsize size,
+			 int owner, gboolean writable)
+{
+  lgi_makeabs (L, owner);
+  lgi_buffer_new_foreign (L, data, size, NULL, NULL, writable, 0);
+  lua_pushlightuserdata (L, &borrowed_cache);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushvalue (L, -2);
+  lua_pushvalue (L, owner);
+  lua_rawset (L, -3);
+  lua_pop (L, 1);
+  lgi_cache_add_dependent (L, &borrowers_cache, owner, -1);
+}
+
+void
+lgi_buffer_detach (lua_State *L, int owner)
+{
+  lgi_makeabs (L, owner);
+  luaL_checkstack (L, 5, "");
+  lgi_cache_take_dependents (L, &borrowers_cache, owner);
+  if (!lua_isnil (L, -1))
+    {
+      lua_pushlightuserdata (L, &borrowed_cache);
+      lua_rawget (L, LUA_REGISTRYINDEX);
+      lua_pushnil (L);
+      while (lua_next (L, -3))
+	{
+	  /* Leave the buffer empty and stop keeping the owner. */
+	  Buffer *buffer = lua_touserdata (L, -2);
+	  buffer->data = NULL;
+	  buffer->size = 0;
+	  buffer->readonly = TRUE;
+	  lua_pop (L, 1);
+	  lua_pushvalue (L, -1);
+	  lua_pushnil (L);
+	  lua_rawset (L, -4);
+	}
+      lua_pop (L, 1);
+    }
+  lua_pop (L, 1);
+}
+
+gpointer
+lgi_buffer_new (lua_State *L, gsize size)
+{
+  Buffer *buffer = buffer_create (L, BUFFER_STORE_OWNED);
+  buffer_resize (L, buffer, size);
+  return buffer_data (L, buffer);
+}
+
+/* Creates buffer sharing the memory of GLib.Bytes, GLib.MappedFile or
+   GLib.ByteArray instance, holding a reference to it.  Lua-side
+   prototype:
+   buffer = bytes.view(source [, writable]) */
+static int
+buffer_view_foreign (lua_State *L)
+{
+  gpointer addr;
+  gboolean writable = lua_toboolean (L, 2);
+
+  lgi_type_get_repotype (L, G_TYPE_BYTES, NULL);
+  lgi_record_2c (L, 1, &addr, FALSE, FALSE, FALSE, TRUE);
+  if (addr != NULL)
+    {
+      /* GBytes are immutable by definition. */
+      gsize size;
+      gconstpointer data = g_bytes_get_data (addr, &size);
+      luaL_argcheck (L, !writable, 2, "GLib.Bytes is immutable");
+      lgi_buffer_new_foreign (L, (gpointer) data, size, g_bytes_ref (addr),
+			      (GDestroyNotify) g_bytes_unref, FALSE, 0);
+      return 1;
+    }
+
+  lgi_type_get_repotype (L, G_TYPE_MAPPED_FILE, NULL);
+  lgi_record_2c (L, 1, &addr, FALSE, FALSE, FALSE, TRUE);
+  if (addr != NULL)
+    {
+      /* Writability of the mapping cannot be queried and writing to
+	 read-only mapping crashes the process, so mapped files are
+	 always viewed read-only. */
+      luaL_argcheck (L, !writable, 2, "GLib.MappedFile is read-only");
+      lgi_buffer_new_foreign (L, g_mapped_file_get_contents (addr),
+			      g_mapped_file_get_length (addr),
+			      g_mapped_file_ref (addr),
+			      (GDestroyNotify) g_mapped_file_unref, FALSE,
+			      0);
+      return 1;
+    }
+
+  lgi_type_get_repotype (L, G_TYPE_BYTE_ARRAY, NULL);
+  lgi_record_2c (L, 1, &addr, FALSE, FALSE, FALSE, TRUE);
+  if (addr != NULL)
+    {
+      GByteArray *array = addr;
+      lgi_buffer_new_foreign (L, array->data, array->len,
+			      g_byte_array_ref (array),
+			      (GDestroyNotify) g_byte_array_unref, writable,
+			      0);
+      ((Buffer *) lua_touserdata (L, -1))->store = BUFFER_STORE_BYTE_ARRAY;
+      return 1;
+    }
+
+  return luaL_argerror (L, 1, "GLib.Bytes, GLib.MappedFile or "
+			"GLib.ByteArray expected");
+}
+
 static const luaL_Reg buffer_reg[] = {
   { "new", buffer_new },
+  { "view", buffer_view_foreign },
   { NULL, NULL }
 };
 
 void
 lgi_buffer_init (lua_State *L)
 {
+  int type, order;
+
+  /* Create cache of owners of borrowed buffers. */
+  lgi_cache_create (L, &borrowed_cache, "k");
+  lgi_cache_create (L, &borrowers_cache, "k");
+
   /* Register metatables. */
   luaL_newmetatable (L, LGI_BYTES_BUFFER);
   luaL_register (L, NULL, buffer_mt_reg);
+
+  /* Create methods table, used by __index. */
+  lua_newtable (L);
+  luaL_register (L, NULL, buffer_methods_reg);
+  for (type = 0; type < (int) G_N_ELEMENTS (buffer_types); type++)
+    for (order = 0; order < 3; order++)
+      {
+	/* Byte order variants make sense only for multibyte types. */
+	if (order != BUFFER_ORDER_NATIVE && buffer_types[type].width == 1)
+	  continue;
+
+	lua_pushinteger (L, type * 3 + order);
+	lua_pushcclosure (L, buffer_get_typed, 1);
+	lua_pushfstring (L, "get_%s%s", buffer_types[type].name,
+			 buffer_orders[order]);
+	lua_insert (L, -2);
+	lua_rawset (L, -3);
+	lua_pushinteger (L, type * 3 + order);
+	lua_pushcclosure (L, buffer_set_typed, 1);
+	lua_pushfstring (L, "set_%s%s", buffer_types[type].name,
+			 buffer_orders[order]);
+	lua_insert (L, -2);
+	lua_rawset (L, -3);
+      }
+  lua_pushcclosure (L, buffer_index, 1);
+  lua_setfield (L, -2, "__index");
   lua_pop (L, 1);
 
   /* Register global API. */
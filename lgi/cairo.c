@@ -0,0 +1,353 @@
+/*
+ * Dynamic Lua binding to GObject using dynamic gobject-introspection.
+ *
+ * Copyright (c) 2026 lgi contributors
+ * Licensed under the MIT license:
+ * http://www.opensource.org/licenses/mit-license.php
+ *
+ * Native helpers of cairo override.  lgi does not link cairo, so the
+ * structures used here replicate layout of cairo public structures,
+ * which is part of the stable cairo ABI.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lgi.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* cairo_path_data_t */
+typedef union _CairoPathData
+{
+  struct
+  {
+    int type;
+    int length;
+  } header;
+  struct
+  {
+    double x, y;
+  } point;
+} CairoPathData;
+
+/* cairo_path_t */
+typedef struct _CairoPath
+{
+  int status;
+  CairoPathData *data;
+  int num_data;
+} CairoPath;
+
+/* cairo_matrix_t */
+typedef struct _CairoMatrix
+{
+  double xx, yx;
+  double xy, yy;
+  double x0, y0;
+} CairoMatrix;
+
+/* Gets address of the record at narg, which must be of cairo-gobject
+   boxed type of given name (e.g. "CairoPath"). */
+static gpointer
+cairo_record_get (lua_State *L, int narg, const char *type_name)
+{
+  gpointer addr = NULL;
+  lgi_type_get_repotype (L, g_type_from_name (type_name), NULL);
+  if (lua_isnil (L, -1))
+    luaL_error (L, "%s: type not loaded", type_name);
+  lgi_record_2c (L, narg, &addr, FALSE, FALSE, FALSE, FALSE);
+  return addr;
+}
+
+/* Names of cairo_path_data_type_t values, and the number of points
+   following the header of the element of given type. */
+static const char *const path_types[] = {
+  "MOVE_TO", "LINE_TO", "CURVE_TO", "CLOSE_PATH", NULL
+};
+static const int path_points[] = { 1, 1, 3, 0 };
+
+/* Iterator closure, upvalues are path proxy (keeping the path alive),
+   its address and index of the next element. */
+static int
+path_iter_next (lua_State *L)
+{
+  CairoPath *path = lua_touserdata (L, lua_upvalueindex (2));
+  int index = lua_tointeger (L, lua_upvalueindex (3)), type, points, i;
+  CairoPathData *data;
+
+  if (index >= path->num_data)
+    return 0;
+
+  /* Check validity of the element. */
+  data = &path->data[index];
+  type = data->header.type;
+  if (type < 0 || type >= (int) G_N_ELEMENTS (path_points))
+    return luaL_error (L, "cairo.Path: bad element type %d", type);
+  points = path_points[type];
+  if (data->header.length < points + 1
+      || index + data->header.length > path->num_data)
+    return luaL_error (L, "cairo.Path: bad element length %d",
+		       data->header.length);
+
+  /* Push the element type followed by point coordinates. */
+  luaL_checkstack (L, 1 + 2 * points, "");
+  lua_pushstring (L, path_types[type]);
+  for (i = 1; i <= points; i++)
+    {
+      lua_pushnumber (L, data[i].point.x);
+      lua_pushnumber (L, data[i].point.y);
+    }
+
+  lua_pushinteger (L, index + data->header.length);
+  lua_replace (L, lua_upvalueindex (3));
+  return 1 + 2 * points;
+}
+
+/* Creates iterator over the path elements, returning type of each
+   element followed by coordinates of its points.  Lua-side prototype:
+   iter = core.cairo.path_iter(path) */
+static int
+path_iter (lua_State *L)
+{
+  CairoPath *path = cairo_record_get (L, 1, "CairoPath");
+  lua_settop (L, 1);
+  lua_pushlightuserdata (L, path);
+  lua_pushinteger (L, 0);
+  lua_pushcclosure (L, path_iter_next, 3);
+  return 1;
+}
+
+/* Gets type of the path element from the array item at index, either
+   type name or its numeric value. */
+static int
+path_get_type (lua_State *L, int index)
+{
+  int type = -1;
+  lua_rawgeti (L, 1, index);
+  if (lua_type (L, -1) == LUA_TNUMBER)
+    type = lua_tointeger (L, -1);
+  else if (lua_type (L, -1) == LUA_TSTRING)
+    {
+      const char *name = lua_tostring (L, -1);
+      for (type = 0; path_types[type] != NULL; type++)
+	if (strcmp (path_types[type], name) == 0)
+	  break;
+    }
+  lua_pop (L, 1);
+
+  if (type < 0 || type >= (int) G_N_ELEMENTS (path_points))
+    luaL_error (L, "cairo.Path: bad element type at index %d", index);
+  return type;
+}
+
+/* Creates cairo_path_t from flat array containing element types,
+   each followed by coordinates of its points.  Returned path is
+   allocated by malloc(), so that it can be freed by
+   cairo_path_destroy().  Lua-side prototype:
+   addr = core.cairo.path_new(array) */
+static int
+path_new (lua_State *L)
+{
+  int length, index, num_data = 0, type, i;
+  CairoPathData *data;
+  CairoPath *path;
+
+  luaL_checktype (L, 1, LUA_TTABLE);
+  length = lua_objlen (L, 1);
+
+  /* Validate the array and find out the number of data elements. */
+  for (index = 1; index <= length; index += 1 + 2 * path_points[type])
+    {
+      type = path_get_type (L, index);
+      if (index + 2 * path_points[type] > length)
+	return luaL_error (L, "cairo.Path: missing coordinates at index %d",
+			   index);
+      for (i = 1; i <= 2 * path_points[type]; i++)
+	{
+	  lua_rawgeti (L, 1, index + i);
+	  if (lua_type (L, -1) != LUA_TNUMBER)
+	    return luaL_error (L, "cairo.Path: number expected at index %d",
+			       index + i);
+	  lua_pop (L, 1);
+	}
+      num_data += 1 + path_points[type];
+    }
+
+  /* Allocate and fill the path. */
+  path = malloc (sizeof (CairoPath));
+  data = num_data ? malloc (num_data * sizeof (CairoPathData)) : NULL;
+  if (path == NULL || (num_data && data == NULL))
+    {
+      free (path);
+      free (data);
+      return luaL_error (L, "cairo.Path: out of memory");
+    }
+  path->status = 0;
+  path->data = data;
+  path->num_data = num_data;
+  for (index = 1; index <= length; index += 1 + 2 * path_points[type])
+    {
+      type = path_get_type (L, index);
+      data->header.type = type;
+      data->header.length = 1 + path_points[type];
+      data++;
+      for (i = 0; i < path_points[type]; i++, data++)
+	{
+	  lua_rawgeti (L, 1, index + 1 + 2 * i);
+	  lua_rawgeti (L, 1, index + 2 + 2 * i);
+	  data->point.x = lua_tonumber (L, -2);
+	  data->point.y = lua_tonumber (L, -1);
+	  lua_pop (L, 2);
+	}
+    }
+
+  lua_pushlightuserdata (L, path);
+  return 1;
+}
+
+/* Transforms single point, as cairo_matrix_transform_point() does. */
+static inline void
+matrix_apply (const CairoMatrix *m, double *x, double *y)
+{
+  double nx = m->xx * *x + m->xy * *y + m->x0;
+  *y = m->yx * *x + m->yy * *y + m->y0;
+  *x = nx;
+}
+
+/* Inverts the matrix the same way as cairo_matrix_invert() does,
+   returns FALSE if the matrix is not invertible. */
+static gboolean
+matrix_invert (CairoMatrix *matrix)
+{
+  CairoMatrix m = *matrix;
+  double det = m.xx * m.yy - m.yx * m.xy;
+  if (det == 0 || det * 0 != 0)
+    return FALSE;
+
+  matrix->xx = m.yy / det;
+  matrix->yx = -m.yx / det;
+  matrix->xy = -m.xy / det;
+  matrix->yy = m.xx / det;
+  matrix->x0 = (m.xy * m.y0 - m.yy * m.x0) / det;
+  matrix->y0 = (m.yx * m.x0 - m.xx * m.y0) / det;
+  return TRUE;
+}
+
+/* Transforms count points stored as pairs of native doubles at
+   source, storing them to target.  Source and target may be the same
+   and need not be aligned. */
+static void
+matrix_transform (const CairoMatrix *m, const guint8 *source,
+		  guint8 *target, gsize count)
+{
+#if defined (__SSE2__)
+  /* Each point is transformed in one vector, as x * (xx, yx) + y *
+     (xy, yy) + (x0, y0). */
+  __m128d cx = _mm_set_pd (m->yx, m->xx);
+  __m128d cy = _mm_set_pd (m->yy, m->xy);
+  __m128d c0 = _mm_set_pd (m->y0, m->x0);
+  for (; count > 0; count--, source += 16, target += 16)
+    {
+      __m128d p = _mm_loadu_pd ((const double *) source);
+      __m128d x = _mm_unpacklo_pd (p, p), y = _mm_unpackhi_pd (p, p);
+      _mm_storeu_pd ((double *) target,
+		     _mm_add_pd (_mm_add_pd (_mm_mul_pd (x, cx),
+					     _mm_mul_pd (y, cy)), c0));
+    }
+#else
+  for (; count > 0; count--, source += 16, target += 16)
+    {
+      double p[2];
+      memcpy (p, source, sizeof (p));
+      matrix_apply (m, &p[0], &p[1]);
+      memcpy (target, p, sizeof (p));
+    }
+#endif
+}
+
+/* Transforms points in flat array or 'bytes' buffer of native
+   doubles, alternating x and y coordinates.  Unless inplace is set,
+   transformed points are stored into new array (or buffer), which is
+   returned.  Lua-side prototype:
+   points = core.cairo.matrix_transform(matrix, points[, inplace[, inverse]]) */
+static int
+matrix_transform_points (lua_State *L)
+{
+  CairoMatrix m;
+  gsize size;
+  guint8 *source;
+  gboolean inplace = lua_toboolean (L, 3);
+  m = *(CairoMatrix *) cairo_record_get (L, 1, "CairoMatrix");
+  if (lua_toboolean (L, 4) && !matrix_invert (&m))
+    return luaL_error (L, "cairo.Matrix: matrix is not invertible");
+
+  lua_settop (L, 2);
+  source = inplace ? lgi_buffer_test_writable (L, 2, &size)
+    : lgi_buffer_test (L, 2, &size);
+  if (source != NULL)
+    {
+      /* Transform whole buffer at once. */
+      guint8 *target;
+      luaL_argcheck (L, size % (2 * sizeof (double)) == 0, 2,
+		     "buffer size not multiple of point size");
+      if (inplace)
+	{
+	  target = source;
+	  lua_pushvalue (L, 2);
+	}
+      else
+	target = lgi_buffer_new (L, size);
+      matrix_transform (&m, source, target, size / (2 * sizeof (double)));
+    }
+  else
+    {
+      /* Transform the array point by point. */
+      int length, i;
+      luaL_argcheck (L, lua_type (L, 2) == LUA_TTABLE, 2,
+		     "table or bytes expected");
+      length = lua_objlen (L, 2);
+      luaL_argcheck (L, length % 2 == 0, 2, "odd number of coordinates");
+      if (inplace)
+	lua_pushvalue (L, 2);
+      else
+	lua_createtable (L, length, 0);
+      for (i = 1; i < length; i += 2)
+	{
+	  double x, y;
+	  lua_rawgeti (L, 2, i);
+	  lua_rawgeti (L, 2, i + 1);
+	  if (lua_type (L, -2) != LUA_TNUMBER
+	      || lua_type (L, -1) != LUA_TNUMBER)
+	    return luaL_error (L, "cairo.Matrix: number expected at index %d",
+			       lua_type (L, -2) != LUA_TNUMBER ? i : i + 1);
+	  x = lua_tonumber (L, -2);
+	  y = lua_tonumber (L, -1);
+	  lua_pop (L, 2);
+	  matrix_apply (&m, &x, &y);
+	  lua_pushnumber (L, x);
+	  lua_rawseti (L, 3, i);
+	  lua_pushnumber (L, y);
+	  lua_rawseti (L, 3, i + 1);
+	}
+    }
+
+  return 1;
+}
+
+static const luaL_Reg cairo_reg[] = {
+  { "matrix_transform", matrix_transform_points },
+  { "path_iter", path_iter },
+  { "path_new", path_new },
+  { NULL, NULL }
+};
+
+void
+lgi_cairo_init (lua_State *L)
+{
+  /* Register 'cairo' API table in main core API table. */
+  lua_newtable (L);
+  luaL_register (L, NULL, cairo_reg);
+  lua_setfield (L, -2, "cairo");
+}
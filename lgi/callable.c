@@ -26,6 +26,43 @@ typedef enum _ParamKind
     PARAM_KIND_ENUM
   } ParamKind;
 
+/* Kinds of values handled directly by the vfunc dispatch plan. */
+typedef enum _PlanKind
+  {
+    /* Value which needs full marshalling, the plan cannot be used. */
+    PLAN_KIND_NONE = 0,
+
+    PLAN_KIND_VOID,
+    PLAN_KIND_BOOLEAN,
+    PLAN_KIND_INT8,
+    PLAN_KIND_UINT8,
+    PLAN_KIND_INT16,
+    PLAN_KIND_UINT16,
+    PLAN_KIND_INT32,
+    PLAN_KIND_UINT32,
+    PLAN_KIND_INT64,
+    PLAN_KIND_UINT64,
+    PLAN_KIND_FLOAT,
+    PLAN_KIND_DOUBLE,
+
+    /* Non-owned input string. */
+    PLAN_KIND_UTF8,
+
+    /* Generic pointer, marshalled as lightuserdata. */
+    PLAN_KIND_POINTER,
+
+    /* Non-owned input object or interface instance. */
+    PLAN_KIND_OBJECT
+  } PlanKind;
+
+/* State of the vfunc dispatch plan of the callable. */
+typedef enum _PlanState
+  {
+    PLAN_STATE_UNKNOWN = 0,
+    PLAN_STATE_NONE,
+    PLAN_STATE_READY
+  } PlanState;
+
 /* Represents single parameter in callable description. */
 typedef struct _Param
 {
@@ -65,6 +102,9 @@ typedef struct _Param
   /* Index into env table attached to the callable, contains repotype
      table for specified argument. */
   guint repotype_index : 4;
+
+  /* Kind of the value in vfunc dispatch plan, one of PlanKind values. */
+  guint plan : 4;
 } Param;
 
 /* Structure representing userdata allocated for any callable, i.e. function,
@@ -87,6 +127,14 @@ typedef struct _Callable
   guint ignore_retval : 1;
   guint is_closure_marshal : 1;
 
+  /* Set when owned byte arrays returned by the callable are adopted
+     by 'bytes' buffers instead of being copied into strings. */
+  guint buffers : 1;
+
+  /* State of vfunc dispatch plan, one of PlanState values.  The plan
+     itself is stored in 'plan' fields of retval and params. */
+  guint plan : 2;
+
   /* Initialized FFI CIF structure. */
   ffi_cif cif;
 
@@ -136,6 +184,9 @@ typedef struct _FfiClosure
       /* Lua reference to associated Callable. */
       int callable_ref;
 
+      /* Associated Callable itself, kept alive by callable_ref. */
+      Callable *callable;
+
       /* Callable's target to be invoked (either function,
 	 userdata/table with __call metafunction or coroutine (which
 	 is resumed instead of called). */
@@ -288,6 +339,7 @@ callable_param_init (Param *param)
   param->call_scoped_user_data = FALSE;
   param->kind = PARAM_KIND_TI;
   param->repotype_index = 0;
+  param->plan = PLAN_KIND_NONE;
 }
 
 static Callable *
@@ -314,6 +366,8 @@ callable_allocate (lua_State *L, int nargs, ffi_type ***ffi_args)
   callable->throws = 0;
   callable->ignore_retval = 0;
   callable->is_closure_marshal = 0;
+  callable->buffers = 0;
+  callable->plan = PLAN_STATE_UNKNOWN;
 
   /* Clear all 'internal' flags inside callable parameters, parameters are then
      marked as internal during processing of their parents. */
@@ -465,6 +519,48 @@ lgi_callable_create (lua_State *L, GICallableInfo *info, gpointer addr)
   return 1;
 }
 
+int
+lgi_callable_create_cached (lua_State *L, GICallableInfo *info)
+{
+  /* Lookup the callable in the cache, using info type and full name
+     of the info as the key.  Full names of callbacks do not contain
+     their own name, so it is appended explicitly; otherwise all
+     callbacks without container would share the same key. */
+  int n;
+  const gchar *name;
+  luaL_checkstack (L, 6, "");
+  lua_pushlightuserdata (L, &callable_cache);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushinteger (L, g_base_info_get_type (info));
+  n = lgi_type_get_name (L, info) + 1;
+  if (g_base_info_get_type (info) == GI_INFO_TYPE_CALLBACK)
+    {
+      name = g_base_info_get_name (info);
+      lua_pushliteral (L, ":");
+      lua_pushstring (L, name ? name : "");
+      n += 2;
+    }
+  lua_concat (L, n);
+  lua_pushvalue (L, -1);
+  lua_rawget (L, -3);
+  if (lua_isnil (L, -1))
+    {
+      /* Create new callable and store it into the cache. */
+      lua_pop (L, 1);
+      lgi_callable_create (L, info, NULL);
+      lua_pushvalue (L, -1);
+      lua_insert (L, -4);
+      lua_rawset (L, -3);
+      lua_pop (L, 1);
+    }
+  else
+    {
+      lua_replace (L, -3);
+      lua_pop (L, 1);
+    }
+  return 1;
+}
+
 static int
 callable_param_get_kind (lua_State *L)
 {
@@ -787,7 +883,18 @@ callable_param_2lua (lua_State *L, Param *param, GIArgument *arg,
 {
   if (param->kind != PARAM_KIND_RECORD)
     {
-      if (param->ti)
+      if (param->ti && param->transfer != GI_TRANSFER_NOTHING
+	  && g_type_info_get_tag (param->ti) == GI_TYPE_TAG_ARRAY)
+	{
+	  /* Owned arrays are marshalled also according to the buffers
+	     mode of this callable. */
+	  lgi_marshal_2lua_array (L, param->ti, param->dir, param->transfer,
+				  arg, parent, callable->info,
+				  args + callable->has_self,
+				  callable->buffers
+				  || *lgi_marshal_buffers (L) != 0);
+	}
+      else if (param->ti)
 	lgi_marshal_2lua (L, param->ti, callable->info ? &param->ai : NULL,
 			  param->dir, param->transfer,
 			  arg, parent, callable->info,
@@ -1095,6 +1202,11 @@ callable_index (lua_State *L)
       lua_pushlightuserdata (L, callable->user_data);
       return 1;
     }
+  else if (g_strcmp0 (verb, "buffers") == 0)
+    {
+      lua_pushboolean (L, callable->buffers);
+      return 1;
+    }
 
   return 0;
 }
@@ -1103,8 +1215,11 @@ static int
 callable_newindex (lua_State *L)
 {
   Callable *callable = callable_get (L, 1);
-  if (g_strcmp0 (lua_tostring (L, 2), "user_data") == 0)
+  const gchar *verb = lua_tostring (L, 2);
+  if (g_strcmp0 (verb, "user_data") == 0)
     callable->user_data = lua_touserdata (L, 3);
+  else if (g_strcmp0 (verb, "buffers") == 0)
+    callable->buffers = lua_toboolean (L, 3);
 
   return 0;
 }
@@ -1436,6 +1551,262 @@ closure_callback (ffi_cif *cif, void *ret, void **args, void *closure_arg)
   lgi_state_leave (block->callback.state_lock);
 }
 
+/* Gets vfunc dispatch plan kind for specified parameter. */
+static PlanKind
+callable_plan_kind (Param *param, gboolean retval)
+{
+  GITypeTag tag;
+
+  if (param->kind != PARAM_KIND_TI || param->ti == NULL || param->internal
+      || (!retval && param->dir != GI_DIRECTION_IN))
+    return PLAN_KIND_NONE;
+
+  tag = g_type_info_get_tag (param->ti);
+  if (g_type_info_is_pointer (param->ti))
+    {
+      /* Pointers are planned only for non-owned input arguments. */
+      if (retval || param->transfer != GI_TRANSFER_NOTHING)
+	return PLAN_KIND_NONE;
+
+      if (tag == GI_TYPE_TAG_VOID)
+	return PLAN_KIND_POINTER;
+      else if (tag == GI_TYPE_TAG_UTF8)
+	return PLAN_KIND_UTF8;
+      else if (tag == GI_TYPE_TAG_INTERFACE)
+	{
+	  GIBaseInfo *ii = g_type_info_get_interface (param->ti);
+	  GIInfoType type = g_base_info_get_type (ii);
+	  g_base_info_unref (ii);
+	  if (type == GI_INFO_TYPE_OBJECT || type == GI_INFO_TYPE_INTERFACE)
+	    return PLAN_KIND_OBJECT;
+	}
+      return PLAN_KIND_NONE;
+    }
+
+  switch (tag)
+    {
+    case GI_TYPE_TAG_VOID:
+      return retval ? PLAN_KIND_VOID : PLAN_KIND_NONE;
+
+#define HANDLE_TAG(name)				\
+      case GI_TYPE_TAG_ ## name:			\
+	return PLAN_KIND_ ## name;
+
+      HANDLE_TAG (BOOLEAN);
+      HANDLE_TAG (INT8);
+      HANDLE_TAG (UINT8);
+      HANDLE_TAG (INT16);
+      HANDLE_TAG (UINT16);
+      HANDLE_TAG (INT32);
+      HANDLE_TAG (UINT32);
+      HANDLE_TAG (INT64);
+      HANDLE_TAG (UINT64);
+      HANDLE_TAG (FLOAT);
+      HANDLE_TAG (DOUBLE);
+#undef HANDLE_TAG
+
+    default:
+      return PLAN_KIND_NONE;
+    }
+}
+
+/* Builds vfunc dispatch plan for the callable, only once for the
+   callable.  Returns TRUE if the plan can be used, i.e. the callable
+   takes object instance as its first argument and all its arguments
+   and return value are simple enough to be handled without full
+   marshalling. */
+static gboolean
+callable_plan_build (Callable *callable)
+{
+  int i;
+
+  if (callable->plan == PLAN_STATE_UNKNOWN)
+    {
+      callable->plan = PLAN_STATE_NONE;
+      if (callable->nargs == 0 || callable->has_self || callable->throws
+	  || callable->is_closure_marshal)
+	return FALSE;
+
+      callable->retval.plan = callable_plan_kind (&callable->retval, TRUE);
+      if (callable->retval.plan == PLAN_KIND_NONE)
+	return FALSE;
+
+      for (i = 0; i < callable->nargs; i++)
+	{
+	  callable->params[i].plan =
+	    callable_plan_kind (&callable->params[i], FALSE);
+	  if (callable->params[i].plan == PLAN_KIND_NONE)
+	    return FALSE;
+	}
+
+      /* The first argument must be the object instance. */
+      if (callable->params[0].plan != PLAN_KIND_OBJECT)
+	return FALSE;
+
+      callable->plan = PLAN_STATE_READY;
+    }
+
+  return callable->plan == PLAN_STATE_READY;
+}
+
+/* Pushes argument described by vfunc dispatch plan kind to the stack. */
+static void
+closure_vfunc_push (lua_State *L, PlanKind kind, gpointer arg)
+{
+  switch (kind)
+    {
+    case PLAN_KIND_BOOLEAN:
+      lua_pushboolean (L, *(gboolean *) arg);
+      break;
+
+#define HANDLE_INT(nameupper, namelower)		\
+      case PLAN_KIND_ ## nameupper:			\
+	lua_pushinteger (L, *(g ## namelower *) arg);	\
+	break;
+
+      HANDLE_INT (INT8, int8);
+      HANDLE_INT (UINT8, uint8);
+      HANDLE_INT (INT16, int16);
+      HANDLE_INT (UINT16, uint16);
+      HANDLE_INT (INT32, int32);
+      HANDLE_INT (UINT32, uint32);
+      HANDLE_INT (INT64, int64);
+      HANDLE_INT (UINT64, uint64);
+#undef HANDLE_INT
+
+    case PLAN_KIND_FLOAT:
+      lua_pushnumber (L, *(gfloat *) arg);
+      break;
+
+    case PLAN_KIND_DOUBLE:
+      lua_pushnumber (L, *(gdouble *) arg);
+      break;
+
+    case PLAN_KIND_UTF8:
+      lua_pushstring (L, *(gchar **) arg);
+      break;
+
+    case PLAN_KIND_POINTER:
+      lua_pushlightuserdata (L, *(gpointer *) arg);
+      break;
+
+    case PLAN_KIND_OBJECT:
+      /* Avoid sinking, same as generic marshalling of input
+	 objects. */
+      lgi_object_2lua (L, *(gpointer *) arg, FALSE, TRUE);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* Stores value from the top of the stack as return value described by
+   vfunc dispatch plan kind.  Integral values are widened to ffi_arg,
+   as libffi requires for closure return values. */
+static void
+closure_vfunc_return (lua_State *L, PlanKind kind, gpointer ret)
+{
+  switch (kind)
+    {
+    case PLAN_KIND_VOID:
+      break;
+
+    case PLAN_KIND_BOOLEAN:
+      *(ffi_arg *) ret = lua_toboolean (L, -1);
+      break;
+
+    case PLAN_KIND_INT8:
+    case PLAN_KIND_INT16:
+    case PLAN_KIND_INT32:
+      *(ffi_sarg *) ret = (gint32) lua_tointeger (L, -1);
+      break;
+
+    case PLAN_KIND_UINT8:
+    case PLAN_KIND_UINT16:
+    case PLAN_KIND_UINT32:
+      *(ffi_arg *) ret = (guint32) lua_tointeger (L, -1);
+      break;
+
+#if LUA_VERSION_NUM >= 503
+    case PLAN_KIND_INT64:
+      *(gint64 *) ret = (gint64) lua_tointeger (L, -1);
+      break;
+
+    case PLAN_KIND_UINT64:
+      *(guint64 *) ret = (guint64) lua_tointeger (L, -1);
+      break;
+#else
+      /* lua_Integer might be narrower than 64 bits. */
+    case PLAN_KIND_INT64:
+      *(gint64 *) ret = (gint64) lua_tonumber (L, -1);
+      break;
+
+    case PLAN_KIND_UINT64:
+      *(guint64 *) ret = (guint64) lua_tonumber (L, -1);
+      break;
+#endif
+
+    case PLAN_KIND_FLOAT:
+      *(gfloat *) ret = (gfloat) lua_tonumber (L, -1);
+      break;
+
+    case PLAN_KIND_DOUBLE:
+      *(gdouble *) ret = lua_tonumber (L, -1);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* Closure callback for Lua overrides of virtual methods, called by
+   libffi when C code invokes the vfunc.  Uses precomputed dispatch
+   plan of the callable instead of full marshalling and calls the
+   target directly in the thread which created the override.  Falls
+   back to generic closure_callback when that thread is not usable. */
+static void
+closure_vfunc_callback (ffi_cif *cif, void *ret, void **args,
+			void *closure_arg)
+{
+  FfiClosure *closure = closure_arg;
+  FfiClosureBlock *block = closure->block;
+  Callable *callable = closure->callable;
+  lua_State *L;
+  int i, stacktop;
+
+  lgi_state_enter (block->callback.state_lock);
+  L = block->callback.L;
+  if (lua_status (L) != 0)
+    {
+      /* Thread is suspended, let generic callback handle it. */
+      closure_callback (cif, ret, args, closure_arg);
+      lgi_state_leave (block->callback.state_lock);
+      return;
+    }
+
+  /* Push target and all arguments, starting with the instance
+     proxy found in the object cache. */
+  stacktop = lua_gettop (L);
+  luaL_checkstack (L, callable->nargs + 1, "");
+  lua_rawgeti (L, LUA_REGISTRYINDEX, closure->target_ref);
+  for (i = 0; i < callable->nargs; i++)
+    closure_vfunc_push (L, callable->params[i].plan, args[i]);
+
+  if (lua_pcall (L, callable->nargs, 1, 0) != 0)
+    {
+      callable_describe (L, callable, closure);
+      g_warning ("Error raised while calling '%s': %s",
+		 lua_tostring (L, -1), lua_tostring (L, -2));
+      lua_pop (L, 2);
+      lua_pushnil (L);
+    }
+
+  closure_vfunc_return (L, callable->retval.plan, ret);
+  lua_settop (L, stacktop);
+  lgi_state_leave (block->callback.state_lock);
+}
+
 /* Destroys specified closure. */
 void
 lgi_closure_destroy (gpointer user_data)
@@ -1496,15 +1867,18 @@ lgi_closure_allocate (lua_State *L, int count)
   return block;
 }
 
-/* Creates closure from Lua function to be passed to C. */
-gpointer
-lgi_closure_create (lua_State *L, gpointer user_data,
-		    int target, gboolean autodestroy)
+/* Creates closure from Lua function to be passed to C.  If vfunc is
+   set and the callable has usable dispatch plan, the closure uses
+   specialized vfunc entry point. */
+static gpointer
+closure_create (lua_State *L, gpointer user_data, int target,
+		gboolean autodestroy, gboolean vfunc)
 {
   FfiClosureBlock* block = user_data;
   FfiClosure *closure;
   Callable *callable;
   gpointer call_addr;
+  void (*entry) (ffi_cif *, void *, void **, void *) = closure_callback;
   int i;
 
   /* Find pointer to target FfiClosure. */
@@ -1519,6 +1893,7 @@ lgi_closure_create (lua_State *L, gpointer user_data,
   call_addr = closure->call_addr;
   closure->created = 1;
   closure->autodestroy = autodestroy;
+  closure->callable = callable;
   closure->callable_ref = luaL_ref (L, LUA_REGISTRYINDEX);
   if (!lua_isthread (L, target))
     {
@@ -1534,8 +1909,11 @@ lgi_closure_create (lua_State *L, gpointer user_data,
     }
 
   /* Create closure. */
+  if (vfunc && !autodestroy && closure->target_ref != LUA_NOREF
+      && callable_plan_build (callable))
+    entry = closure_vfunc_callback;
   if (ffi_prep_closure_loc (&closure->ffi_closure, &callable->cif,
-			    closure_callback, closure, call_addr) != FFI_OK)
+			    entry, closure, call_addr) != FFI_OK)
     {
       lua_concat (L, lgi_type_get_name (L, callable->info));
       luaL_error (L, "failed to prepare closure for `%'", lua_tostring (L, -1));
@@ -1545,6 +1923,19 @@ lgi_closure_create (lua_State *L, gpointer user_data,
   return call_addr;
 }
 
+gpointer
+lgi_closure_create (lua_State *L, gpointer user_data,
+		    int target, gboolean autodestroy)
+{
+  return closure_create (L, user_data, target, autodestroy, FALSE);
+}
+
+gpointer
+lgi_closure_create_vfunc (lua_State *L, gpointer user_data, int target)
+{
+  return closure_create (L, user_data, target, FALSE, TRUE);
+}
+
 /* Creates new Callable instance according to given gi.info. Lua prototype:
    callable = callable.new(callable_info[, addr]) or
    callable = callable.new(description_table[, addr]) */
@@ -127,35 +127,55 @@ end
 
 -- _element implementation for objects, checks parent and implemented
 -- interfaces if element cannot be found in current typetable.
+-- Inherited elements are remembered in _cached table of the class
+-- together with the owning type, so that following lookups of the
+-- same symbol do not walk the hierarchy again.  Only elements
+-- reported with the owner are cached; elements resolved dynamically
+-- from the instance are returned without it.  Derived classes are not
+-- flattened, because they can be modified at any time.  Cached
+-- elements are tagged by current epoch, which becomes stale whenever
+-- a member shadowing any flattened symbol is assigned to a class or
+-- interface.
 local internals = { _native = true, _type = true, _gtype = true,
-		    _class = true, class = true }
+		    _class = true, class = true, _dispose = true }
 function class.class_mt:_element(instance, symbol)
    -- Special handling of internal symbols.
    if instance and internals[symbol] then return symbol, symbol end
 
    -- Check default implementation.
-   local element, category = component.mt._element(self, instance, symbol)
-   if element then return element, category end
+   local element, category, owner = component.mt._element(
+      self, instance, symbol)
+   if element then return element, category, owner end
 
    -- Check parent and all implemented interfaces.
    local parent = rawget(self, '_parent')
    if parent then
-      element, category = parent:_element(instance, symbol)
-      if element then return element, category end
+      element, category, owner = parent:_element(instance, symbol)
+   end
+   if not element then
+      local implements = rawget(self, '_implements') or {}
+      for _, implemented in pairs(implements) do
+	 element, category, owner = implemented:_element(
+	    instance, symbol, self)
+	 if element then break end
+      end
    end
-   local implements = rawget(self, '_implements') or {}
-   for _, implemented in pairs(implements or {}) do
-      element, category = implemented:_element(instance, symbol, self)
-      if element then return element, category end
+   if owner and type(symbol) == 'string'
+      and getmetatable(self) ~= class.derived_mt then
+      local cached = rawget(self, '_cached')
+      if not cached then
+	 cached = {}
+	 rawset(self, '_cached', cached)
+      end
+      cached[symbol] = { element, category, owner, class.flatten(symbol) }
    end
+   return element, category, owner
 end
 
 -- Implementation of field accessor.  Note that compound fields are
 -- not supported in classes (because they are not seen in the wild and
 -- I'm lazy).
-function class.class_mt:_access_field(instance, field, ...)
-   return core.object.field(instance, field, ...)
-end
+class.class_mt._access_field = core.object.access_field
 
 -- Add accessor '_native' handling.
 function class.class_mt:_access_native(instance)
@@ -175,6 +195,12 @@ function class.class_mt:_access_gtype(instance)
    return ti.g_class.g_type
 end
 
+-- Add accessor '_dispose' handling, returns method which releases
+-- the instance deterministically.
+function class.class_mt:_access_dispose(instance)
+   return core.object.release
+end
+
 -- Add accessor '_class' handling.
 function class.class_mt:_access_class(instance)
    local gtype = class.class_mt._access_gtype(self, instance)
@@ -220,21 +246,23 @@ end
 function class.load_interface(namespace, info)
    -- Load all components of the interface.
    local interface = component.create(info, class.interface_mt)
-   interface._property = load_properties(info)
-   interface._method = component.get_category(info.methods, load_method)
-   interface._signal = component.get_category(
-      info.signals, nil, load_signal_name, load_signal_name_reverse)
-   interface._constant = component.get_category(info.constants, core.constant)
+   rawset(interface, '_property', load_properties(info))
+   rawset(interface, '_method',
+	  component.get_category(info.methods, load_method))
+   rawset(interface, '_signal', component.get_category(
+      info.signals, nil, load_signal_name, load_signal_name_reverse))
+   rawset(interface, '_constant',
+	  component.get_category(info.constants, core.constant))
    local type_struct = info.type_struct
    if type_struct then
-      interface._virtual = component.get_category(
-	 info.vfuncs, nil, load_vfunc_name, load_vfunc_name_reverse)
-      interface._class = record.load(type_struct)
+      rawset(interface, '_virtual', component.get_category(
+	 info.vfuncs, nil, load_vfunc_name, load_vfunc_name_reverse))
+      rawset(interface, '_class', record.load(type_struct))
       interface._class._gtype = interface._gtype
       interface._class._allow = true
       interface._class._parent = core.repo.GObject.TypeInterface
    end
-   interface._new = find_constructor(info)
+   rawset(interface, '_new', find_constructor(info))
    return interface
 end
 
@@ -252,18 +280,20 @@ function class.load_class(namespace, info)
    -- otherwise defaults to class_mt.
    local class = component.create(
       info, parent and getmetatable(parent) or class.class_mt)
-   class._parent = parent
-   class._property = load_properties(info)
-   class._method = component.get_category(info.methods, load_method)
-   class._signal = component.get_category(
-      info.signals, nil, load_signal_name, load_signal_name_reverse)
-   class._constant = component.get_category(info.constants, core.constant)
-   class._field = component.get_category(info.fields)
+   rawset(class, '_parent', parent)
+   rawset(class, '_property', load_properties(info))
+   rawset(class, '_method',
+	  component.get_category(info.methods, load_method))
+   rawset(class, '_signal', component.get_category(
+      info.signals, nil, load_signal_name, load_signal_name_reverse))
+   rawset(class, '_constant',
+	  component.get_category(info.constants, core.constant))
+   rawset(class, '_field', component.get_category(info.fields))
    local type_struct = info.type_struct
    if type_struct then
-      class._virtual = component.get_category(
-	 info.vfuncs, nil, load_vfunc_name, load_vfunc_name_reverse)
-      class._class = record.load(type_struct)
+      rawset(class, '_virtual', component.get_category(
+	 info.vfuncs, nil, load_vfunc_name, load_vfunc_name_reverse))
+      rawset(class, '_class', record.load(type_struct))
       class._class._gtype = class._gtype
       class._class._allow = true
       class._class._parent =
@@ -276,11 +306,16 @@ function class.load_class(namespace, info)
       local iface = interfaces[i]
       implements[iface.fullname] = core.repo[iface.namespace][iface.name]
    end
-   class._implements = implements
-   class._new = find_constructor(info)
+   rawset(class, '_implements', implements)
+   rawset(class, '_new', find_constructor(info))
    return class
 end
 
+-- Definition of GInstanceInitFunc callback, taking instance as a
+-- plain pointer.
+local instance_init_def = {
+   name = 'GObject.InstanceInitFunc', ret = ti.void, ti.ptr, ti.ptr }
+
 local register_static = core.callable.new(GObject.type_register_static)
 local type_query = core.callable.new(GObject.type_query)
 local type_add_interface_static = core.callable.new(
@@ -325,17 +360,17 @@ function class.class_mt:derive(typename, ifaces)
    -- later after the type is already created, but we need to pass its
    -- address right now during type initialization.  Therefore, a stub
    -- which looks up the init method of the type dynamically is used
-   -- instead.
+   -- instead.  The instance is received as raw pointer, so that no
+   -- intermediate GTypeInstance record is created for it.
    local function instance_init(instance)
       local _init = rawget(new_class, '_init')
       if _init then
 	 -- Convert instance to real type and call init with it.
-	 _init(core.object.new(core.record.query(instance, 'addr'),
-	       false, true))
+	 _init(core.object.new(instance, false, true))
       end
    end
    local instance_init_guard, instance_init_addr = core.marshal.callback(
-      GObject.InstanceInitFunc, instance_init)
+      instance_init_def, instance_init)
    new_class._guard._instance_init = instance_init_guard
 
    -- Prepare GTypeInfo with the registration.
@@ -393,13 +428,43 @@ end
 
 class.derived_mt = class.class_mt:clone('derived', {})
 
+-- Current epoch of flattened inherited elements.  Assigning new
+-- member to a class or interface can shadow elements which were
+-- already flattened into derived classes, so if the symbol (or any
+-- symbol, in case that whole category is assigned) was flattened, it
+-- marks the epoch stale and starts a new one.  Replacing
+-- existing members is detected by comparing with the owner of the
+-- flattened element.  Loaders populate classes using rawset, so only
+-- assignments after the load are checked.
+class.epoch = {}
+local flattened = {}
+function class.flatten(symbol)
+   flattened[symbol] = true
+   return class.epoch
+end
+local function class_newindex(self, name, value)
+   rawset(self, name, value)
+   if type(name) == 'string' and name:match('^_access') then
+      core.marshal.access_epoch()
+   end
+   if flattened[name] or (next(flattened) and type(name) == 'string'
+			  and name:match('^_') and type(value) == 'table') then
+      class.epoch.stale = true
+      class.epoch = {}
+      flattened = {}
+   end
+end
+class.class_mt.__newindex = class_newindex
+class.interface_mt.__newindex = class_newindex
+
 -- Support for 'priv' pseudomember, holding table with user
 -- implementation data.
 function class.derived_mt:_element(instance, symbol)
    -- Special handling of 'priv' attribute.
    if instance and symbol == 'priv' then return symbol, '_priv' end
 
-   -- Check default implementation.
+   -- Check default implementation.  The owner is not reported, so
+   -- that classes derived from this one do not flatten its elements.
    local element, category = class.class_mt._element(self, instance, symbol)
    if element then return element, category end
 end
@@ -433,7 +498,7 @@ function class.derived_mt:__newindex(name, target)
 	 class_struct = self._class
 	 override = self._override
       end
-      local guard, vfunc = core.marshal.callback(
+      local guard, vfunc = core.marshal.vfunc(
 	 class_struct[name].callable, target)
       override[name] = vfunc
       self._guard[container.name .. ':' .. name] = guard
@@ -441,6 +506,9 @@ function class.derived_mt:__newindex(name, target)
       -- Simply assign to type.  This most probably means adding new
       -- member function to the class (or some static member).
       rawset(self, name, target)
+      if type(name) == 'string' and name:match('^_access') then
+	 core.marshal.access_epoch()
+      end
    end
 end
 
@@ -33,43 +33,33 @@ function component.get_category(children, xform_value,
    -- Early shortcircuit; no elements, no table needed at all.
    if #children == 0 then return nil end
 
-   -- Index contains array of indices which were still not retrieved
-   -- from 'children' table, and table part contains name->index
-   -- mapping.
-   local index, mt = {}, {}
-   for i = 1, #children do index[i] = i end
+   -- Names of children which were already loaded (or found to be
+   -- unusable), these are never looked up again, so that removing
+   -- them from the category table hides them.
+   local loaded, mt = {}, {}
+   local function xvalue(arg)
+      if not xform_value then return arg end
+      if arg then
+	 local ok, res = pcall(xform_value, arg)
+	 return ok and res
+      end
+   end
 
    -- Fully resolves the category (i.e. loads everything remaining to
    -- be loaded in given category) and disconnects on-demand loading
    -- metatable.
    local function resolve(category)
-      -- Load al values from unknown indices.
-      local ei, en, val
-      local function xvalue(arg)
-	 if not xform_value then return arg end
-	 if arg then
-	    local ok, res = pcall(xform_value, arg)
-	    return ok and res
-	 end
-      end
-      while #index > 0 do
-	 ei = children[table.remove(index)]
-	 val = xvalue(ei)
-	 if val then
-	    en = ei.name
+      for i = 1, #children do
+	 local ei = children[i]
+	 local en = ei.name
+	 if not loaded[en] then
+	    loaded[en] = true
+	    local val = xvalue(ei)
 	    en = not xform_name_reverse and en or xform_name_reverse(en)
-	    if en then category[en] = val end
+	    if en and val then category[en] = val end
 	 end
       end
 
-      -- Load all known indices.
-      for en, idx in pairs(index) do
-    local e = en
-	 val = xvalue(children[idx])
-	 e = not xform_name_reverse and e or xform_name_reverse(e)
-	 if e then category[e] = val end
-      end
-
       -- Metatable is no longer needed, disconnect it.
       return setmetatable(category, nil)
    end
@@ -81,36 +71,17 @@ function component.get_category(children, xform_value,
       -- Transform name by transform function.
       local name = not xform_name and requested_name
 	 or xform_name(requested_name)
-      if not name then return end
-
-      -- Check, whether we already know its index.
-      local idx, val = index[name]
-      if idx then
-	 -- We know at least the index, so get info directly.
-	 val = children[idx]
-	 index[name] = nil
-      else
-	 -- Not yet, go through unknown indices and try to find the
-	 -- name.
-	 while #index > 0 do
-	    idx = table.remove(index)
-	    val = children[idx]
-	    local en = val.name
-	    if en == name then break end
-	    val = nil
-	    index[en] = idx
-	 end
-      end
+      if not name or loaded[name] then return end
 
-      -- If there is nothing in the index, we can disconnect
-      -- metatable, because everything is already loaded.
-      if not next(index) then
-	 setmetatable(self, nil)
-      end
+      -- Children are indexable by name; the lookup is served by the
+      -- name index built natively on the first query, so it does not
+      -- depend on the number of children.
+      local val = children[name]
 
       -- Transform found value and store it into the category (self)
       -- table.
       if not val then return nil end
+      loaded[name] = true
       if xform_value then val = xform_value(val) end
       if not val then return nil end
       self[requested_name] = val
@@ -177,6 +148,10 @@ function component.mt:_access(instance, symbol, ...)
    return element
 end
 
+-- Let native instance access know the default _access, typetables
+-- which do not override it get cached elements dispatched natively.
+core.marshal.access_default(component.mt._access)
+
 -- Keyword translation dictionary.  Used for translating Lua keywords
 -- which might appear as symbols in typelibs into Lua-neutral identifiers.
 local keyword_dictionary = {
@@ -185,8 +160,9 @@ local keyword_dictionary = {
    _true = 'true', _and = 'and', _or = 'or', _not = 'not',
 }
 
--- Retrieves (element, category) pair from given componenttable and
--- instance for given symbol.
+-- Retrieves (element, category, owner) triplet from given
+-- componenttable and instance for given symbol.  Owner is the
+-- component in which the element was found.
 function component.mt:_element(instance, symbol, origin)
    -- This generic version can work only with strings.  Refuse
    -- everything other, hoping that some more specialized _element
@@ -199,14 +175,27 @@ function component.mt:_element(instance, symbol, origin)
 
    -- Check whether symbol is directly accessible in the component.
    local element = rawget(self, symbol)
-   if element then return element end
+   if element then return element, nil, self end
 
    -- Check whether symbol is accessible in cached directory of the
-   -- component, packed as element value and category
+   -- component, packed as element value, category and optionally
+   -- owner and epoch, if the element is inherited.  Inherited
+   -- elements are valid only until their epoch becomes stale and
+   -- while the owner does not have the member replaced.
    local cached = rawget(self, '_cached')
    if cached then
       element = cached[symbol]
-      if element then return element[1], element[2] end
+      if element then
+	 local owner = element[3]
+	 if not owner then return element[1], element[2], self end
+	 local current = rawget(owner, symbol)
+	 if not element[4].stale
+	    and (current == nil or current == element[1]) then
+	    return element[1], element[2], owner
+	 end
+	 cached[symbol] = nil
+	 element = nil
+      end
    end
 
    -- Decompose symbol name, in case that it contains category prefix
@@ -240,18 +229,18 @@ function component.mt:_element(instance, symbol, origin)
 	 -- No category or no special category handler is present,
 	 -- store it directly, which results in fastest access.  This
 	 -- is most typical for methods.
-	 self[symbol] = element
+	 rawset(self, symbol, element)
       else
 	 -- Store into _cached table, because we have to preserve the
 	 -- category.
 	 if not cached then
 	    cached = {}
-	    self._cached = cached
+	    rawset(self, '_cached', cached)
 	 end
 	 cached[symbol] = { element, category }
       end
 
-      return element, category
+      return element, category, self
    end
 end
 
@@ -285,23 +274,9 @@ end
 
 -- Implementation of attribute accessor.  Attribute is either function
 -- to be directly invoked, or table containing set and get functions.
-function component.mt:_access_attribute(instance, element, ...)
-   -- If element is a table, assume that this table contains 'get' and
-   -- 'set' methods.  Dispatch to them, and error out if they are
-   -- missing.
-   if type(element) == 'table' then
-      local mode = select('#', ...) == 0 and 'get' or 'set'
-      if not element[mode] then
-	 error(("%s: cannot %s `%s'"):format(
-		  self._name, mode == 'get' and 'read' or 'write',
-		  element._name or '<unknown>'), 5)
-      end
-      element = element[mode]
-   end
-
-   -- Invoke attribute access function.
-   return element(instance, ...)
-end
+-- Implemented natively, so that it can be dispatched directly from
+-- instance access.
+component.mt._access_attribute = core.marshal.access_attribute
 
 -- Pretty prints type name
 function component.mt:__tostring()
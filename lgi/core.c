@@ -104,6 +104,26 @@ lgi_udata_test (lua_State *L, int narg, const char *name)
   return udata;
 }
 
+/* lightuserdata key to LUA_REGISTRYINDEX containing metatable of
+   released proxies. */
+static int released_mt;
+
+void
+lgi_udata_release (lua_State *L, int narg)
+{
+  lgi_makeabs (L, narg);
+  lua_pushlightuserdata (L, &released_mt);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_setmetatable (L, narg);
+}
+
+static int
+released_noop (lua_State *L)
+{
+  (void) L;
+  return 0;
+}
+
 void
 lgi_cache_create (lua_State *L, gpointer key, const char *mode)
 {
@@ -119,6 +139,53 @@ lgi_cache_create (lua_State *L, gpointer key, const char *mode)
   lua_rawset (L, LUA_REGISTRYINDEX);
 }
 
+void
+lgi_cache_add_dependent (lua_State *L, gpointer key, int owner,
+			 int dependent)
+{
+  lgi_makeabs (L, owner);
+  lgi_makeabs (L, dependent);
+  luaL_checkstack (L, 4, "");
+  lua_pushlightuserdata (L, key);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushvalue (L, owner);
+  lua_rawget (L, -2);
+  if (lua_isnil (L, -1))
+    {
+      /* Create the set of dependents, with weak keys same as the
+	 cache itself. */
+      lua_pop (L, 1);
+      lua_newtable (L);
+      if (lua_getmetatable (L, -2))
+	lua_setmetatable (L, -2);
+      lua_pushvalue (L, owner);
+      lua_pushvalue (L, -2);
+      lua_rawset (L, -4);
+    }
+  lua_pushvalue (L, dependent);
+  lua_pushboolean (L, 1);
+  lua_rawset (L, -3);
+  lua_pop (L, 2);
+}
+
+void
+lgi_cache_take_dependents (lua_State *L, gpointer key, int owner)
+{
+  lgi_makeabs (L, owner);
+  luaL_checkstack (L, 4, "");
+  lua_pushlightuserdata (L, key);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushvalue (L, owner);
+  lua_rawget (L, -2);
+  if (!lua_isnil (L, -1))
+    {
+      lua_pushvalue (L, owner);
+      lua_pushnil (L);
+      lua_rawset (L, -4);
+    }
+  lua_replace (L, -2);
+}
+
 int
 lgi_type_get_name (lua_State *L, GIBaseInfo *info)
 {
@@ -269,6 +336,179 @@ lgi_guard_create (lua_State *L, GDestroyNotify destroy)
   return &guard->data;
 }
 
+/* Estimated native memory owned by proxies of the state. */
+typedef struct _LgiMemory
+{
+  /* Total size and count of accounted allocations. */
+  gsize total;
+  gsize count;
+
+  /* Size accounted since the last GC step. */
+  gsize debt;
+} LgiMemory;
+
+/* Accounted allocations are accumulated until they reach this size,
+   then the GC is stepped by the accumulated size. */
+#define LGI_MEMORY_STEP (64 * 1024)
+
+/* lightuserdata key to LUA_REGISTRYINDEX containing LgiMemory. */
+static int memory;
+
+/* lightuserdata key to LUA_REGISTRYINDEX containing cache of
+   resolved '_memsize' hooks, typetable -> hook or fixed size. */
+static int memory_hooks;
+
+static LgiMemory *
+memory_get (lua_State *L)
+{
+  LgiMemory *mem;
+  lua_pushlightuserdata (L, &memory);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  mem = lua_touserdata (L, -1);
+  lua_pop (L, 1);
+  return mem;
+}
+
+/* Converts memory size on the top of the stack, non-numeric, negative
+   and too large values are treated as 0. */
+static gsize
+memory_size (lua_State *L)
+{
+  lua_Number size;
+  if (lua_type (L, -1) != LUA_TNUMBER)
+    return 0;
+  size = lua_tonumber (L, -1);
+  return (size > 0 && size < (lua_Number) G_MAXSIZE) ? (gsize) size : 0;
+}
+
+gsize
+lgi_memory_estimate (lua_State *L, int typetable, int narg, gpointer addr,
+		     gboolean size_field)
+{
+  gsize size = 0;
+
+  lgi_makeabs (L, typetable);
+  lgi_makeabs (L, narg);
+  luaL_checkstack (L, 5, "");
+  lua_pushlightuserdata (L, &memory_hooks);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushvalue (L, typetable);
+  lua_rawget (L, -2);
+  if (lua_isnil (L, -1))
+    {
+      /* Look up '_memsize' in the typetable and its parents. */
+      lua_pop (L, 1);
+      lua_pushvalue (L, typetable);
+      for (;;)
+	{
+	  lua_pushliteral (L, "_memsize");
+	  lua_rawget (L, -2);
+	  if (!lua_isnil (L, -1))
+	    {
+	      /* Resolve C function hooks to their address. */
+	      gpointer symbol = lgi_gi_load_function (L, -2, "_memsize");
+	      if (symbol)
+		{
+		  lua_pop (L, 1);
+		  lua_pushlightuserdata (L, symbol);
+		}
+	      break;
+	    }
+
+	  lua_pop (L, 1);
+	  lua_pushliteral (L, "_parent");
+	  lua_rawget (L, -2);
+	  lua_replace (L, -2);
+	  if (lua_isnil (L, -1))
+	    {
+	      /* No hook, use static size of the type if requested.
+		 The nil parent stays below as the slot replaced by
+		 the result. */
+	      if (size_field)
+		lua_getfield (L, typetable, "_size");
+	      else
+		lua_pushnil (L);
+	      if (!lua_isnumber (L, -1))
+		{
+		  lua_pop (L, 1);
+		  lua_pushinteger (L, 0);
+		}
+	      break;
+	    }
+	}
+
+      /* Store the hook into the cache. */
+      lua_replace (L, -2);
+      lua_pushvalue (L, typetable);
+      lua_pushvalue (L, -2);
+      lua_rawset (L, -4);
+    }
+
+  if (lua_islightuserdata (L, -1))
+    size = ((gsize (*)(gpointer)) lua_touserdata (L, -1)) (addr);
+  else if (lua_type (L, -1) == LUA_TNUMBER)
+    size = memory_size (L);
+  else
+    {
+      /* Lua hooks are called in protected mode, failing hooks do not
+	 contribute to the estimate. */
+      lua_pushvalue (L, -1);
+      lua_pushvalue (L, narg);
+      if (lua_pcall (L, 1, 1, 0) == 0)
+	size = memory_size (L);
+      lua_pop (L, 1);
+    }
+
+  lua_pop (L, 2);
+  return size;
+}
+
+void
+lgi_memory_add (lua_State *L, gsize size)
+{
+  LgiMemory *mem;
+  if (size == 0)
+    return;
+
+  mem = memory_get (L);
+  mem->total += size;
+  mem->count++;
+  mem->debt += size;
+  if (mem->debt >= LGI_MEMORY_STEP)
+    {
+      /* Make the collector progress as if the memory was allocated
+	 by Lua itself. */
+      int kbytes = MIN (mem->debt >> 10, G_MAXINT);
+      mem->debt = 0;
+      lua_gc (L, LUA_GCSTEP, kbytes);
+    }
+}
+
+void
+lgi_memory_remove (lua_State *L, gsize size)
+{
+  LgiMemory *mem;
+  if (size == 0)
+    return;
+
+  mem = memory_get (L);
+  mem->total -= size;
+  mem->count--;
+  mem->debt = mem->debt > size ? mem->debt - size : 0;
+}
+
+/* Returns total estimated size of native memory owned by proxies and
+   number of accounted proxies.  Lua-side prototype:
+   total, count = core.memory() */
+static int
+core_memory (lua_State *L)
+{
+  LgiMemory *mem = memory_get (L);
+  lua_pushnumber (L, mem->total);
+  lua_pushnumber (L, mem->count);
+  return 2;
+}
+
 /* Converts any allowed GType kind to lightuserdata form. */
 static int
 core_gtype (lua_State *L)
@@ -614,6 +854,7 @@ static const struct luaL_Reg lgi_reg[] = {
   { "module", core_module },
   { "upcase", core_upcase },
   { "downcase", core_downcase },
+  { "memory", core_memory },
   { NULL, NULL }
 };
 
@@ -731,6 +972,17 @@ luaopen_lgi_corelgilua51 (lua_State* L)
   lua_setfield (L, -2, "__gc");
   lua_pop (L, 1);
 
+  /* Register metatable of released proxies.  It makes them unusable,
+     but keeps __gc and __close, so that closing already released
+     proxy is harmless. */
+  lua_pushlightuserdata (L, &released_mt);
+  lua_newtable (L);
+  lua_pushcfunction (L, released_noop);
+  lua_setfield (L, -2, "__gc");
+  lua_pushcfunction (L, released_noop);
+  lua_setfield (L, -2, "__close");
+  lua_rawset (L, LUA_REGISTRYINDEX);
+
   /* Register 'module' metatable. */
   luaL_newmetatable (L, UD_MODULE);
   luaL_register (L, NULL, module_reg);
@@ -756,6 +1008,12 @@ luaopen_lgi_corelgilua51 (lua_State* L)
   lua_setmetatable (L, -2);
   lua_rawset (L, LUA_REGISTRYINDEX);
 
+  /* Create native memory accounting structures. */
+  lua_pushlightuserdata (L, &memory);
+  memset (lua_newuserdata (L, sizeof (LgiMemory)), 0, sizeof (LgiMemory));
+  lua_rawset (L, LUA_REGISTRYINDEX);
+  lgi_cache_create (L, &memory_hooks, "k");
+
   /* Register 'lgi.core' interface. */
   lua_newtable (L);
   luaL_register (L, NULL, lgi_reg);
@@ -782,6 +1040,8 @@ luaopen_lgi_corelgilua51 (lua_State* L)
 
   /* Initialize modules. */
   lgi_buffer_init (L);
+  lgi_pixels_init (L);
+  lgi_cairo_init (L);
   lgi_gi_init (L);
   lgi_marshal_init (L);
   lgi_record_init (L);
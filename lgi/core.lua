@@ -19,4 +19,11 @@ function core.uncamel(name)
    return core.downcase(name:gsub('([%l%d])([%u])', '%1_%2'))
 end
 
+-- Releases the native resources of the proxy (object or record)
+-- immediately, without waiting for the garbage collector.  The proxy
+-- is unusable afterwards.  Returns true if the argument was a proxy.
+function core.release(proxy)
+   return core.record.release(proxy) or core.object.release(proxy) or false
+end
+
 return core
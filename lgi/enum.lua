@@ -8,8 +8,8 @@
 --
 ------------------------------------------------------------------------------
 
-local setmetatable, pairs, type, select
-   = setmetatable, pairs, type, select
+local setmetatable, getmetatable, pairs, type, select, rawget
+   = setmetatable, getmetatable, pairs, type, select, rawget
 local core = require 'lgi.core'
 local gi = core.gi
 local component = require 'lgi.component'
@@ -21,6 +21,29 @@ local enum = {
    bitflags_mt = component.mt:clone('flags', { '_method' }),
 }
 
+-- Builds reverse lookup indices of loaded enum or bitflags type.
+-- Enums get '_reverse' table mapping value to name, bitflags get
+-- '_flags' array of { name, flag } pairs and '_decomposed' cache of
+-- already decomposed values.
+function enum.build_index(enum_type)
+   local reverse, flags = {}, {}
+   for name, value in pairs(enum_type) do
+      if type(value) == 'number' and name:sub(1, 1) ~= '_'
+	 and name ~= 'error_domain' then
+	 local known = reverse[value]
+	 if not known or name < known then reverse[value] = name end
+	 flags[#flags + 1] = { name, value }
+      end
+   end
+   if getmetatable(enum_type) == enum.bitflags_mt then
+      enum_type._flags = flags
+      enum_type._decomposed = setmetatable({}, { __mode = 'v' })
+   else
+      enum_type._reverse = reverse
+   end
+   return enum_type
+end
+
 function enum.load(info, meta)
    local enum_type = component.create(info, meta)
    enum_type.error_domain = info.error_domain
@@ -45,16 +68,24 @@ function enum.load(info, meta)
       enum_type[core.upcase(mi.name)] = mi.value
    end
 
-   -- Install metatable providing reverse lookup (i.e name(s) by
-   -- value).
-   return enum_type
+   -- Build indices providing reverse lookup (i.e name(s) by value).
+   return enum.build_index(enum_type)
 end
 
 -- Enum reverse mapping, value->name.
 function enum.enum_mt:_element(instance, value)
    if type(value) == 'number' then
+      local reverse = rawget(self, '_reverse')
+      local name = reverse and reverse[value]
+      if name then return name end
+
+      -- Not indexed, e.g. value added after the type was loaded.
       for name, val in pairs(self) do
-	 if val == value then return name end
+	 if val == value and type(name) == 'string'
+	    and name:sub(1, 1) ~= '_' then
+	    if reverse then reverse[value] = name end
+	    return name
+	 end
       end
       return value
    else
@@ -77,15 +108,28 @@ end
 -- of contained bits.
 function enum.bitflags_mt:_element(instance, value)
    if type(value) == 'number' then
-      local result, remainder = {}, value
-      for name, flag in pairs(self) do
-	 if type(flag) == 'number' and name:sub(1, 1) ~= '_' and
-	    band(value, flag) == flag then
-	    result[name] = true
-	    remainder = remainder - flag
+      if not rawget(self, '_flags') then enum.build_index(self) end
+
+      -- Decomposition is cached as array of names followed by the
+      -- remainder; result is always a fresh table, because callers
+      -- are free to modify it.
+      local decomposed = self._decomposed[value]
+      if not decomposed then
+	 local flags, remainder = self._flags, value
+	 decomposed = {}
+	 for i = 1, #flags do
+	    local flag = flags[i]
+	    if band(value, flag[2]) == flag[2] then
+	       decomposed[#decomposed + 1] = flag[1]
+	       remainder = remainder - flag[2]
+	    end
 	 end
+	 decomposed.remainder = remainder
+	 self._decomposed[value] = decomposed
       end
-      if remainder > 0 then result[1] = remainder end
+      local result = {}
+      for i = 1, #decomposed do result[decomposed[i]] = true end
+      if decomposed.remainder > 0 then result[1] = decomposed.remainder end
       return result
    else
       return component.mt._element(self, instance, value)
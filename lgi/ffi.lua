@@ -102,7 +102,7 @@ function ffi.load_enum(gtype, name)
    if GLib.check_version(2, 86, 0) then
       type_class:unref()
    end
-   return enum_component
+   return enum.build_index(enum_component)
 end
 
 -- Aligns offset to specified alignment.
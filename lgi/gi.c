@@ -59,12 +59,15 @@ lgi_gi_load_function (lua_State *L, int typetable, const char *name)
 }
 
 /* Userdata representing single group of infos (e.g. methods on
-   object, fields of struct etc.).  Emulates Lua table for access. */
+   object, fields of struct etc.).  Emulates Lua table for access.
+   Name lookups are served from 'names' table, mapping name to index+1,
+   which is built on the first lookup by name. */
 typedef struct _Infos
 {
   GIBaseInfo *info;
   gint count;
   InfosItemGet item_get;
+  GHashTable *names;
 } Infos;
 #define LGI_GI_INFOS "lgi.gi.infos"
 
@@ -90,17 +93,34 @@ infos_index (lua_State *L)
   else
     {
       const gchar *name = luaL_checkstring (L, 2);
-      for (n = 0; n < infos->count; n++)
-	{
-	  GIBaseInfo *info = infos->item_get (infos->info, n);
-	  if (strcmp (g_base_info_get_name (info), name) == 0)
-	    return lgi_gi_info_new (L, info);
+      if (infos->names == NULL)
+	{
+	  /* Walk all infos once and remember their names, so that
+	     following lookups do not have to touch the typelib.  In
+	     case of duplicate names, the first one wins, as in
+	     sequential lookup. */
+	  infos->names = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, NULL);
+	  for (n = 0; n < infos->count; n++)
+	    {
+	      GIBaseInfo *info = infos->item_get (infos->info, n);
+	      const gchar *info_name = g_base_info_get_name (info);
+	      if (info_name != NULL
+		  && g_hash_table_lookup (infos->names, info_name) == NULL)
+		g_hash_table_insert (infos->names, g_strdup (info_name),
+				     GINT_TO_POINTER (n + 1));
+	      g_base_info_unref (info);
+	    }
+	}
 
-	  g_base_info_unref (info);
+      n = GPOINTER_TO_INT (g_hash_table_lookup (infos->names, name));
+      if (n == 0)
+	{
+	  lua_pushnil (L);
+	  return 1;
 	}
 
-      lua_pushnil (L);
-      return 1;
+      return lgi_gi_info_new (L, infos->item_get (infos->info, n - 1));
     }
 }
 
@@ -109,6 +129,8 @@ infos_gc (lua_State *L)
 {
   Infos *infos = luaL_checkudata (L, 1, LGI_GI_INFOS);
   g_base_info_unref (infos->info);
+  if (infos->names != NULL)
+    g_hash_table_unref (infos->names);
 
   /* Unset the metatable / make the infos unusable */
   lua_pushnil (L);
@@ -126,6 +148,7 @@ infos_new (lua_State *L, GIBaseInfo *info, gint count, InfosItemGet item_get)
   infos->info = g_base_info_ref (info);
   infos->count = count;
   infos->item_get = item_get;
+  infos->names = NULL;
   return 1;
 }
 
@@ -72,11 +72,44 @@ GType lgi_type_get_gtype (lua_State *L, int narg);
    handler. Returns pointer to user_data stored inside guard. */
 gpointer *lgi_guard_create (lua_State *L, GDestroyNotify destroy);
 
+/* Replaces metatable of the released proxy at narg with metatable,
+   which makes the proxy unusable, but keeps no-op __gc and __close
+   metamethods. */
+void lgi_udata_release (lua_State *L, int narg);
+
 /* Creates cache table (optionally with given table __mode), stores it
    into registry to specified userdata address. */
 void
 lgi_cache_create (lua_State *L, gpointer key, const char *mode);
 
+/* Records value at dependent as dependent of the value at owner in
+   the cache stored in registry under key, which must be created with
+   "k" mode.  Dependents of each owner are kept in their own set with
+   weak keys, so that they can be found without traversing the whole
+   cache. */
+void lgi_cache_add_dependent (lua_State *L, gpointer key, int owner,
+			      int dependent);
+
+/* Removes the set of dependents of the value at owner from the cache
+   stored in registry under key and pushes it, or pushes nil if the
+   owner has no dependents. */
+void lgi_cache_take_dependents (lua_State *L, gpointer key, int owner);
+
+/* Estimates size of native memory owned by the proxy at narg, whose
+   typetable is at index typetable and native address is addr.  Uses
+   '_memsize' of the typetable or its parents, which is either C
+   function 'gsize (*)(gpointer)' or Lua function called with the
+   proxy.  Types without '_memsize' have the size of their '_size'
+   field if size_field is TRUE, otherwise 0. */
+gsize lgi_memory_estimate (lua_State *L, int typetable, int narg,
+			   gpointer addr, gboolean size_field);
+
+/* Accounts native memory owned by a proxy, so that the Lua GC is
+   stepped proportionally to it, and removes it again when the memory
+   is no longer owned by the proxy. */
+void lgi_memory_add (lua_State *L, gsize size);
+void lgi_memory_remove (lua_State *L, gsize size);
+
 /* Initialization of modules. */
 void lgi_marshal_init (lua_State *L);
 void lgi_record_init (lua_State *L);
@@ -84,6 +117,8 @@ void lgi_object_init (lua_State *L);
 void lgi_callable_init (lua_State *L);
 void lgi_gi_init (lua_State *L);
 void lgi_buffer_init (lua_State *L);
+void lgi_pixels_init (lua_State *L);
+void lgi_cairo_init (lua_State *L);
 
 /* Checks whether given argument is of specified udata - similar to
    luaL_testudata, which is missing in Lua 5.1 */
@@ -94,6 +129,38 @@ lgi_udata_test (lua_State *L, int narg, const char *name);
    http://permalink.gmane.org/gmane.comp.lang.lua.general/79288 */
 #define LGI_BYTES_BUFFER "bytes.bytearray"
 
+/* Checks whether given argument is 'bytes' buffer (or a view of one).
+   If yes, returns pointer to its data and stores its size into size
+   (if not NULL), otherwise returns NULL. */
+gpointer lgi_buffer_test (lua_State *L, int narg, gsize *size);
+
+/* Same as lgi_buffer_test, but raises an error when the buffer is
+   read-only. */
+gpointer lgi_buffer_test_writable (lua_State *L, int narg, gsize *size);
+
+/* Creates 'bytes' buffer pointing to foreign data and pushes it to
+   the stack.  Owner of the data is released by destroy when the
+   buffer is collected.  Non-writable buffers refuse modification from
+   Lua.  If the data are owned exclusively by the buffer, memsize
+   specifies their size accounted to the garbage collector. */
+void lgi_buffer_new_foreign (lua_State *L, gpointer data, gsize size,
+			     gpointer owner, GDestroyNotify destroy,
+			     gboolean writable, gsize memsize);
+
+/* Creates 'bytes' buffer pointing to foreign data owned by the Lua
+   value at index owner, which is kept alive by the buffer, and pushes
+   it to the stack. */
+void lgi_buffer_new_borrowed (lua_State *L, gpointer data, gsize size,
+			      int owner, gboolean writable);
+
+/* Detaches all buffers borrowed from the Lua value at index owner,
+   because its memory is going away.  Detached buffers are empty. */
+void lgi_buffer_detach (lua_State *L, int owner);
+
+/* Creates new zero-filled 'bytes' buffer of given size, pushes it to
+   the stack and returns pointer to its data. */
+gpointer lgi_buffer_new (lua_State *L, gsize size);
+
 /* Metatable name of userdata - gi wrapped 'GIBaseInfo*' */
 #define LGI_GI_INFO "lgi.gi.info"
 
@@ -113,6 +180,13 @@ gpointer lgi_state_get_lock (lua_State *L);
 void lgi_state_enter (gpointer left_state);
 void lgi_state_leave (gpointer state_lock);
 
+/* Returns pointer to LGI_BUFFERS_* flags, which control whether
+   owned byte arrays are marshalled to Lua as 'bytes' buffers adopting
+   the array instead of copying it into Lua string.  The _GLOBAL flag
+   is set by core.marshal.buffers(). */
+#define LGI_BUFFERS_GLOBAL 1
+int *lgi_marshal_buffers (lua_State *L);
+
 /* Special value for 'parent' argument of marshal_2c/lua.  When parent
    is set to this value, marshalling takes place always into pointer
    on the C side.  This isuseful when marshalling value from/to lists,
@@ -150,11 +224,26 @@ void lgi_marshal_2lua (lua_State *L, GITypeInfo *ti, GIArgInfo *ai,
 		       gpointer source, int parent,
 		       GICallableInfo *ci, void *args);
 
+/* Marshalls array from GLib/C to Lua, same as lgi_marshal_2lua.  If
+   buffers is set, owned byte arrays are adopted by 'bytes' buffers
+   regardless of the global mode. */
+void lgi_marshal_2lua_array (lua_State *L, GITypeInfo *ti, GIDirection dir,
+			     GITransfer xfer, gpointer source, int parent,
+			     GICallableInfo *ci, void *args, gboolean buffers);
+
 /* Marshalls field to/from given memory (struct, union or
    object). Returns number of results pushed to the stack (0 or 1). */
 int lgi_marshal_field (lua_State *L, gpointer object, gboolean getmode,
 		       int parent_arg, int field_arg, int val_arg);
 
+/* Marshals contents of GValue of simple fundamental type (numeric,
+   boolean, string, enum, flags or object) to the stack and back.
+   Return FALSE without touching the value or the stack when the value
+   is not simple, or the Lua value is not of matching type; the caller
+   should fall back to GObject.Value marshallers then. */
+gboolean lgi_marshal_value_2lua (lua_State *L, const GValue *value);
+gboolean lgi_marshal_value_2c (lua_State *L, int narg, GValue *value);
+
 /* Implementation of object/record _access invocation. */
 int lgi_marshal_access (lua_State *L, gboolean getmode,
 			int compound_arg, int element_arg, int val_arg);
@@ -163,6 +252,11 @@ int lgi_marshal_access (lua_State *L, gboolean getmode,
    it to the stack. */
 int lgi_callable_create (lua_State *L, GICallableInfo *ci, gpointer addr);
 
+/* Similar to lgi_callable_create, but for callables without address
+   (i.e. callbacks implemented in Lua).  Such callables are cached per
+   info, so that closures for the same info share single instance. */
+int lgi_callable_create_cached (lua_State *L, GICallableInfo *ci);
+
 /* Parses callable from table-driven info description. */
 int lgi_callable_parse (lua_State *L, int info, gpointer addr);
 
@@ -177,6 +271,12 @@ gpointer lgi_closure_allocate (lua_State *L, int count);
 gpointer lgi_closure_create (lua_State* L, gpointer user_data,
 			     int target, gboolean autodestroy);
 
+/* Similar to lgi_closure_create, but for Lua overrides of virtual
+   methods.  When the callable signature allows it, the closure
+   dispatches through precomputed plan instead of full marshalling. */
+gpointer lgi_closure_create_vfunc (lua_State *L, gpointer user_data,
+				   int target);
+
 /* GDestroyNotify-compatible callback for destroying closure. */
 void lgi_closure_destroy (gpointer user_data);
 
@@ -208,6 +308,16 @@ int lgi_object_2lua (lua_State *L, gpointer obj, gboolean own,
 gpointer lgi_object_2c (lua_State *L, int narg, GType gtype, gboolean optional,
 			gboolean nothrow, gboolean transfer);
 
+/* Stores value on the top of the stack (and pops it) into the slot
+   of object's proxy identified by key, so that the value lives as
+   long as the proxy.  Proxies with slots own GObjects by toggle
+   reference.  Returns FALSE if the object has no proxy or cannot hold
+   slots. */
+gboolean lgi_object_set_slot (lua_State *L, gpointer obj, gpointer key);
+
+/* Pushes contents of the slot of object's proxy, or nil. */
+void lgi_object_get_slot (lua_State *L, gpointer obj, gpointer key);
+
 #if !GLIB_CHECK_VERSION(2, 30, 0)
 /* Workaround for broken g_struct_info_get_size() for GValue, see
    https://bugzilla.gnome.org/show_bug.cgi?id=657040 */
@@ -309,11 +309,12 @@ byte_array_detach (GByteArray *array)
 }
 
 /* Marshalls array from Lua to C. Returns number of temporary elements
-   pushed to the stack. */
+   pushed to the stack.  If writable is set, C side may modify the
+   array, so read-only buffers are not accepted for it. */
 static int
 marshal_2c_array (lua_State *L, GITypeInfo *ti, GIArrayType atype,
 		  gpointer *out_array, gssize *out_size, int narg,
-		  gboolean optional, GITransfer transfer)
+		  gboolean optional, GITransfer transfer, gboolean writable)
 {
   GITypeInfo* eti;
   gssize objlen, esize;
@@ -345,10 +346,10 @@ marshal_2c_array (lua_State *L, GITypeInfo *ti, GIArrayType atype,
 	  && atype == GI_ARRAY_TYPE_C)
 	{
 	  size_t size = 0;
-	  *out_array = lgi_udata_test (L, narg, LGI_BYTES_BUFFER);
-	  if (*out_array)
-	    size = lua_objlen (L, narg);
-	  else
+	  *out_array = (writable && transfer == GI_TRANSFER_NOTHING)
+	    ? lgi_buffer_test_writable (L, narg, &size)
+	    : lgi_buffer_test (L, narg, &size);
+	  if (!*out_array)
 	    *out_array = (gpointer *) lua_tolstring (L, narg, &size);
 
 	  if (transfer != GI_TRANSFER_NOTHING)
@@ -455,10 +456,47 @@ marshal_2c_array (lua_State *L, GITypeInfo *ti, GIArrayType atype,
   return vals;
 }
 
+/* Registry key of the userdata holding LGI_BUFFERS_* flags. */
+static int buffers;
+
+int *
+lgi_marshal_buffers (lua_State *L)
+{
+  int *flags;
+  lua_pushlightuserdata (L, &buffers);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  flags = lua_touserdata (L, -1);
+  lua_pop (L, 1);
+  return flags;
+}
+
+/* Pushes 'bytes' buffer adopting owned byte array. */
+static void
+marshal_2lua_buffer (lua_State *L, GIArrayType atype, gpointer array,
+		     gpointer data, gsize len)
+{
+  GDestroyNotify destroy;
+  switch (atype)
+    {
+    case GI_ARRAY_TYPE_ARRAY:
+      destroy = (GDestroyNotify) g_array_unref;
+      break;
+
+    case GI_ARRAY_TYPE_BYTE_ARRAY:
+      destroy = (GDestroyNotify) g_byte_array_unref;
+      break;
+
+    default:
+      destroy = g_free;
+    }
+
+  lgi_buffer_new_foreign (L, data, len, array, destroy, TRUE, len);
+}
+
 static void
 marshal_2lua_array (lua_State *L, GITypeInfo *ti, GIDirection dir,
 		    GIArrayType atype, GITransfer transfer,
-		    gpointer array, gssize size, int parent)
+		    gpointer array, gssize size, int parent, gboolean buffers)
 {
   GITypeInfo *eti;
   gssize len = 0, esize;
@@ -525,10 +563,18 @@ marshal_2lua_array (lua_State *L, GITypeInfo *ti, GIDirection dir,
      it.  See https://github.com/pavouk/lgi/issues/57 */
   if (g_type_info_get_tag (eti) == GI_TYPE_TAG_UINT8)
     {
-      /* UINT8 arrays are marshalled as Lua strings. */
+      /* UINT8 arrays are marshalled as Lua strings, or, if requested,
+	 owned ones are adopted by 'bytes' buffers without copying. */
       if (len < 0)
 	len = data ? strlen(data) : 0;
-      if (data != NULL || len != 0)
+      if (transfer != GI_TRANSFER_NOTHING && array != NULL
+	  && atype != GI_ARRAY_TYPE_PTR_ARRAY && buffers)
+	{
+	  marshal_2lua_buffer (L, atype, array, data, len);
+	  lua_remove (L, eti_guard);
+	  return;
+	}
+      else if (data != NULL || len != 0)
         lua_pushlstring (L, data, len);
       else
         lua_pushnil (L);
@@ -926,6 +972,54 @@ marshal_2c_callable (lua_State *L, GICallableInfo *ci, GIArgInfo *ai,
   return nret;
 }
 
+/* Converts enum or flags value at narg to number, expects repotable of
+   the enum on the top of the stack and replaces it with the number.
+   Symbolic names are looked up directly in the repotable, other values
+   are converted by calling the repotable ('constructor'). */
+static void
+marshal_2c_enum_value (lua_State *L, int narg)
+{
+  if (lua_type (L, narg) == LUA_TSTRING)
+    {
+      lua_pushvalue (L, narg);
+      lua_rawget (L, -2);
+      if (lua_type (L, -1) == LUA_TNUMBER)
+	{
+	  lua_replace (L, -2);
+	  return;
+	}
+      lua_pop (L, 1);
+    }
+  lua_pushvalue (L, narg);
+  lua_call (L, 1, 1);
+}
+
+/* Converts numeric enum or flags value on the top of the stack to its
+   symbolic representation, expects repotable of the enum right below
+   it.  Enum values are looked up in the repotable's '_reverse' index,
+   flags and values missing in the index are converted by indexing the
+   repotable. */
+static void
+marshal_2lua_enum_value (lua_State *L)
+{
+  lua_pushliteral (L, "_reverse");
+  lua_rawget (L, -3);
+  if (lua_istable (L, -1))
+    {
+      lua_pushvalue (L, -2);
+      lua_rawget (L, -2);
+      if (!lua_isnil (L, -1))
+	{
+	  lua_replace (L, -3);
+	  lua_pop (L, 1);
+	  return;
+	}
+      lua_pop (L, 1);
+    }
+  lua_pop (L, 1);
+  lua_gettable (L, -2);
+}
+
 /* Marshalls single value from Lua to GLib/C. */
 int
 lgi_marshal_2c (lua_State *L, GITypeInfo *ti, GIArgInfo *ai,
@@ -939,6 +1033,13 @@ lgi_marshal_2c (lua_State *L, GITypeInfo *ti, GIArgInfo *ai,
   GITypeTag tag = g_type_info_get_tag (ti);
   GIArgument *arg = target;
 
+  /* Typelib does not record constness of pointers.  Input strings and
+     arrays are read-only by convention, other (inout) arguments might
+     be modified by C side, so read-only buffers are refused for
+     them. */
+  gboolean writable = (ai != NULL
+		       && g_arg_info_get_direction (ai) != GI_DIRECTION_IN);
+
   /* Convert narg stack position to absolute one, because during
      marshalling some temporary items might be pushed to the stack,
      which would disrupt relative stack addressing of the value. */
@@ -990,7 +1091,9 @@ lgi_marshal_2c (lua_State *L, GITypeInfo *ti, GIArgInfo *ai,
 	else if (!optional || (type != LUA_TNIL && type != LUA_TNONE))
 	{
 	  if (type == LUA_TUSERDATA)
-	    str = (gchar *) lgi_udata_test (L, narg, LGI_BYTES_BUFFER);
+	    str = (gchar *) (writable
+			     ? lgi_buffer_test_writable (L, narg, NULL)
+			     : lgi_buffer_test (L, narg, NULL));
 	  if (str == NULL)
 	    str = (gchar *) luaL_checkstring (L, narg);
 	}
@@ -1035,8 +1138,7 @@ lgi_marshal_2c (lua_State *L, GITypeInfo *ti, GIArgInfo *ai,
 	    if (lua_type (L, narg) != LUA_TNUMBER)
 	      {
 		lgi_type_get_repotype (L, G_TYPE_INVALID, info);
-		lua_pushvalue (L, narg);
-		lua_call (L, 1, 1);
+		marshal_2c_enum_value (L, narg);
 		narg = -1;
 	      }
 
@@ -1100,7 +1202,7 @@ lgi_marshal_2c (lua_State *L, GITypeInfo *ti, GIArgInfo *ai,
 	gssize size;
 	GIArrayType atype = g_type_info_get_array_type (ti);
 	nret = marshal_2c_array (L, ti, atype, &arg->v_pointer, &size,
-				 narg, optional, transfer);
+				 narg, optional, transfer, writable);
 
 	/* Fill in array length argument, if it is specified. */
 	if (atype == GI_ARRAY_TYPE_C)
@@ -1136,8 +1238,9 @@ lgi_marshal_2c (lua_State *L, GITypeInfo *ti, GIArgInfo *ai,
 		arg->v_pointer = lua_touserdata (L, narg);
 	      else
 		{
-		  /* Check memory buffer. */
-		  arg->v_pointer = lgi_udata_test (L, narg, LGI_BYTES_BUFFER);
+		  /* Check memory buffer.  Generic pointer target might
+		     be written to, so the buffer must be writable. */
+		  arg->v_pointer = lgi_buffer_test_writable (L, narg, NULL);
 		  if (!arg->v_pointer)
 		    {
 		      /* Check object. */
@@ -1227,7 +1330,7 @@ lgi_marshal_2c_caller_alloc (lua_State *L, GITypeInfo *ti, GIArgument *val,
 		marshal_2lua_array (L, ti, GI_DIRECTION_OUT,
 				    GI_ARRAY_TYPE_ARRAY,
 				    GI_TRANSFER_EVERYTHING, *array_guard,
-				    -1, pos);
+				    -1, pos, *lgi_marshal_buffers (L));
 
 		/* Deactivate old guard, everything was marshalled
 		   into the newly created and marshalled table. */
@@ -1249,6 +1352,24 @@ lgi_marshal_2c_caller_alloc (lua_State *L, GITypeInfo *ti, GIArgument *val,
   return handled;
 }
 
+/* Marshalls array from GLib/C to Lua, the length of the array is
+   fetched from ci and args.  If buffers is set, owned byte arrays are
+   adopted by 'bytes' buffers regardless of the global mode. */
+void
+lgi_marshal_2lua_array (lua_State *L, GITypeInfo *ti, GIDirection dir,
+			GITransfer transfer, gpointer source, int parent,
+			GICallableInfo *ci, void *args, gboolean buffers)
+{
+  GIArgument *arg = source;
+  GIArrayType atype = g_type_info_get_array_type (ti);
+  gssize size = -1;
+  gpointer ptr = g_type_info_is_pointer (ti) ? arg->v_pointer : arg;
+  lgi_makeabs (L, parent);
+  array_get_or_set_length (ti, &size, 0, ci, args);
+  marshal_2lua_array (L, ti, dir, atype, transfer, ptr, size, parent,
+		      buffers);
+}
+
 /* Marshalls single value from GLib/C to Lua.  Returns 1 if something
    was pushed to the stack. */
 void
@@ -1327,7 +1448,7 @@ lgi_marshal_2lua (lua_State *L, GITypeInfo *ti, GIArgInfo *ai, GIDirection dir,
 			      arg, parent);
 
 	    /* Get symbolic value from the table. */
-	    lua_gettable (L, -2);
+	    marshal_2lua_enum_value (L);
 
 	    /* Remove the table from the stack. */
 	    lua_remove (L, -2);
@@ -1383,13 +1504,8 @@ lgi_marshal_2lua (lua_State *L, GITypeInfo *ti, GIArgInfo *ai, GIDirection dir,
       break;
 
     case GI_TYPE_TAG_ARRAY:
-      {
-	GIArrayType atype = g_type_info_get_array_type (ti);
-	gssize size = -1;
-	gpointer ptr = g_type_info_is_pointer (ti) ? arg->v_pointer : arg;
-	array_get_or_set_length (ti, &size, 0, ci, args);
-	marshal_2lua_array (L, ti, dir, atype, transfer, ptr, size, parent);
-      }
+      lgi_marshal_2lua_array (L, ti, dir, transfer, source, parent, ci, args,
+			      *lgi_marshal_buffers (L));
       break;
 
     case GI_TYPE_TAG_GSLIST:
@@ -1515,19 +1631,18 @@ lgi_marshal_field (lua_State *L, gpointer object, gboolean getmode,
 				  NULL, NULL);
 
 		/* Replace numeric field with symbolic value. */
-		lua_gettable (L, -3);
-		lua_replace (L, -3);
-		lua_pop (L, 1);
+		lua_remove (L, -2);
+		marshal_2lua_enum_value (L);
+		lua_replace (L, -2);
 		return 1;
 	      }
 	    else
 	      {
 		/* Convert enum symbol to numeric value. */
-		if (lua_type (L, val_arg != LUA_TNUMBER))
+		if (lua_type (L, val_arg) != LUA_TNUMBER)
 		  {
-		    lua_pushvalue (L, -1);
-		    lua_pushvalue (L, val_arg);
-		    lua_call (L, 1, 1);
+		    lua_pushvalue (L, -2);
+		    marshal_2c_enum_value (L, val_arg);
 		    lua_replace (L, val_arg);
 		  }
 
@@ -1561,10 +1676,272 @@ lgi_marshal_field (lua_State *L, gpointer object, gboolean getmode,
   return nret;
 }
 
+/* Key of the registry table which maps category names to names of
+   their '_access<category>' handlers, so that the handler names are
+   not concatenated on each access. */
+static int access_handlers;
+
+/* Key of the registry table which maps typetables (weakly) to their
+   cached members used by native access, i.e. '_access' and
+   '_access<category>' handlers.  Each such table contains the access
+   epoch in which it was filled at index 0. */
+static int access_cache;
+
+/* Current access epoch, incremented whenever any member which could
+   change resolution of cached access handlers is assigned. */
+static lua_Integer access_epoch;
+
+/* Key of the registry slot with the default component _access
+   implementation.  Cached elements are dispatched natively only for
+   typetables which do not override it. */
+static int access_default;
+
+/* Checks whether '_cached' entry on the top of the stack is still
+   valid, i.e. it is either not inherited, or its epoch is not stale
+   and its owner still contains the same element for the symbol at
+   element_arg. */
+static gboolean
+marshal_access_valid (lua_State *L, int element_arg)
+{
+  gboolean valid;
+  lua_rawgeti (L, -1, 3);
+  if (lua_isnil (L, -1))
+    {
+      lua_pop (L, 1);
+      return TRUE;
+    }
+
+  lua_pushvalue (L, element_arg);
+  lua_rawget (L, -2);
+  lua_rawgeti (L, -3, 1);
+  valid = lua_isnil (L, -2) || lua_rawequal (L, -2, -1);
+  lua_pop (L, 3);
+  if (valid)
+    {
+      lua_rawgeti (L, -1, 4);
+      if (lua_istable (L, -1))
+	{
+	  lua_pushliteral (L, "stale");
+	  lua_rawget (L, -2);
+	  valid = lua_isnil (L, -1);
+	  lua_pop (L, 1);
+	}
+      lua_pop (L, 1);
+    }
+  return valid;
+}
+
+/* Tries to find element and category for the symbol at element_arg in
+   typetable, consulting only entries already stored directly in the
+   typetable or in its '_cached' table, i.e. without invoking any Lua
+   code.  On success, pushes element and category (nil for no
+   category) and returns TRUE. */
+static gboolean
+marshal_access_lookup (lua_State *L, int typetable, int element_arg)
+{
+  const gchar *name;
+  if (lua_type (L, element_arg) != LUA_TSTRING)
+    return FALSE;
+
+  /* Internal symbols and symbols which are handled specially by
+     _element implementations before the cache is consulted are left
+     for Lua-side dispatch. */
+  name = lua_tostring (L, element_arg);
+  if (name[0] == '_' || strcmp (name, "class") == 0
+      || strcmp (name, "priv") == 0)
+    return FALSE;
+
+  /* Check element stored directly in the typetable. */
+  lua_pushvalue (L, element_arg);
+  lua_rawget (L, typetable);
+  if (lua_toboolean (L, -1))
+    {
+      lua_pushnil (L);
+      return TRUE;
+    }
+  lua_pop (L, 1);
+
+  /* Check '_cached' table, containing { element, category, owner,
+     epoch } entries.  Inherited entries which are no longer valid are
+     left for Lua-side _element, which drops them. */
+  lua_pushliteral (L, "_cached");
+  lua_rawget (L, typetable);
+  if (lua_istable (L, -1))
+    {
+      lua_pushvalue (L, element_arg);
+      lua_rawget (L, -2);
+      if (lua_istable (L, -1) && marshal_access_valid (L, element_arg))
+	{
+	  lua_rawgeti (L, -1, 1);
+	  lua_rawgeti (L, -2, 2);
+	  lua_remove (L, -3);
+	  lua_remove (L, -3);
+	  return TRUE;
+	}
+      lua_pop (L, 1);
+    }
+  lua_pop (L, 1);
+  return FALSE;
+}
+
+/* Replaces the member name on the top of the stack with the value of
+   that member of the typetable.  Members stored directly in the
+   typetable are always preferred, other are looked up through the
+   whole type hierarchy only once per access epoch and cached. */
+static void
+marshal_access_resolve (lua_State *L, int typetable)
+{
+  int name = lua_gettop (L);
+  lua_pushvalue (L, name);
+  lua_rawget (L, typetable);
+  if (!lua_isnil (L, -1))
+    {
+      lua_replace (L, name);
+      return;
+    }
+  lua_pop (L, 1);
+
+  /* Find the cache of the typetable, start a new one if it is
+     missing or was filled in an older epoch. */
+  lua_pushlightuserdata (L, &access_cache);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushvalue (L, typetable);
+  lua_rawget (L, -2);
+  if (lua_istable (L, -1))
+    {
+      lua_rawgeti (L, -1, 0);
+      if (lua_tointeger (L, -1) != access_epoch)
+	lua_pushnil (L);
+      else
+	lua_pushvalue (L, -2);
+      lua_replace (L, -3);
+      lua_pop (L, 1);
+    }
+  if (!lua_istable (L, -1))
+    {
+      lua_pop (L, 1);
+      lua_newtable (L);
+      lua_pushinteger (L, access_epoch);
+      lua_rawseti (L, -2, 0);
+      lua_pushvalue (L, typetable);
+      lua_pushvalue (L, -2);
+      lua_rawset (L, -4);
+    }
+  lua_replace (L, -2);
+
+  /* Look the member up in the cache, missing members are stored as
+     false. */
+  lua_pushvalue (L, name);
+  lua_rawget (L, -2);
+  if (lua_isnil (L, -1))
+    {
+      lua_pop (L, 1);
+      lua_pushvalue (L, name);
+      lua_gettable (L, typetable);
+      lua_pushvalue (L, name);
+      if (lua_isnil (L, -2))
+	lua_pushboolean (L, 0);
+      else
+	lua_pushvalue (L, -2);
+      lua_rawset (L, -4);
+    }
+  else if (lua_isboolean (L, -1) && !lua_toboolean (L, -1))
+    {
+      lua_pop (L, 1);
+      lua_pushnil (L);
+    }
+  lua_replace (L, name);
+  lua_pop (L, 1);
+}
+
+/* Pushes '_access<category>' handler of the typetable, or false if
+   there is none. */
+static void
+marshal_access_handler (lua_State *L, int typetable, int category)
+{
+  lua_pushlightuserdata (L, &access_handlers);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushvalue (L, category);
+  lua_rawget (L, -2);
+  if (lua_isnil (L, -1))
+    {
+      lua_pop (L, 1);
+      lua_pushliteral (L, "_access");
+      lua_pushvalue (L, category);
+      lua_concat (L, 2);
+      lua_pushvalue (L, category);
+      lua_pushvalue (L, -2);
+      lua_rawset (L, -4);
+    }
+  lua_replace (L, -2);
+  marshal_access_resolve (L, typetable);
+  if (lua_isnil (L, -1))
+    {
+      lua_pop (L, 1);
+      lua_pushboolean (L, 0);
+    }
+}
+
+/* Checks whether the typetable uses the default _access
+   implementation. */
+static gboolean
+marshal_access_native (lua_State *L, int typetable)
+{
+  gboolean native;
+  lua_pushliteral (L, "_access");
+  marshal_access_resolve (L, typetable);
+  lua_pushlightuserdata (L, &access_default);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  native = !lua_isnil (L, -1) && lua_rawequal (L, -2, -1);
+  lua_pop (L, 2);
+  return native;
+}
+
 int
 lgi_marshal_access (lua_State *L, gboolean getmode,
 		    int compound_arg, int element_arg, int val_arg)
 {
+  int typetable = lua_gettop (L);
+
+  /* Try to dispatch already known elements directly to their category
+     handlers, avoiding Lua-side _access and _element calls. */
+  if (marshal_access_native (L, typetable)
+      && marshal_access_lookup (L, typetable, element_arg))
+    {
+      if (lua_isnil (L, -1))
+	lua_pushboolean (L, 0);
+      else
+	marshal_access_handler (L, typetable, typetable + 2);
+
+      if (lua_isfunction (L, -1))
+	{
+	  /* Invoke typetable:_access<category>(instance, element, ...) */
+	  lua_pushvalue (L, typetable);
+	  lua_pushvalue (L, compound_arg);
+	  lua_pushvalue (L, typetable + 1);
+	  if (getmode)
+	    {
+	      lua_call (L, 3, 1);
+	      return 1;
+	    }
+	  else
+	    {
+	      lua_pushvalue (L, val_arg);
+	      lua_call (L, 4, 0);
+	      return 0;
+	    }
+	}
+      else if (getmode)
+	{
+	  /* No category handler, element itself is the value. */
+	  lua_pop (L, 2);
+	  return 1;
+	}
+
+      /* Let Lua-side _access report the error. */
+      lua_settop (L, typetable);
+    }
+
   lua_getfield (L, -1, "_access");
   lua_pushvalue (L, -2);
   lua_pushvalue (L, compound_arg);
@@ -1582,6 +1959,62 @@ lgi_marshal_access (lua_State *L, gboolean getmode,
     }
 }
 
+/* Registers default implementation of component's _access, objects
+   which do not override it get their cached elements dispatched
+   natively.  Lua-side prototype:
+   marshal.access_default(access) */
+static int
+marshal_access_default (lua_State *L)
+{
+  luaL_checktype (L, 1, LUA_TFUNCTION);
+  lua_pushlightuserdata (L, &access_default);
+  lua_pushvalue (L, 1);
+  lua_rawset (L, LUA_REGISTRYINDEX);
+  return 0;
+}
+
+/* Starts new access epoch, invalidating all natively cached access
+   handlers.  Lua-side prototype:
+   marshal.access_epoch() */
+static int
+marshal_access_epoch (lua_State *L)
+{
+  (void) L;
+  access_epoch++;
+  return 0;
+}
+
+/* Default implementation of component's _access_attribute.  Attribute
+   is either function to be directly invoked, or table containing set
+   and get functions.  Lua-side prototype:
+   res = marshal.access_attribute(typetable, instance, element[, val]) */
+static int
+marshal_access_attribute (lua_State *L)
+{
+  gboolean getmode = lua_gettop (L) <= 3;
+  if (lua_istable (L, 3))
+    {
+      lua_getfield (L, 3, getmode ? "get" : "set");
+      if (lua_isnil (L, -1))
+	{
+	  lua_getfield (L, 3, "_name");
+	  lua_getfield (L, 1, "_name");
+	  return luaL_error (L, "%s: cannot %s `%s'", lua_tostring (L, -1),
+			     getmode ? "read" : "write",
+			     luaL_optstring (L, -2, "<unknown>"));
+	}
+      lua_replace (L, 3);
+    }
+
+  /* Invoke element(instance, ...). */
+  lua_remove (L, 1);
+  lua_pushvalue (L, 2);
+  lua_remove (L, 2);
+  lua_insert (L, 1);
+  lua_call (L, lua_gettop (L) - 1, LUA_MULTRET);
+  return lua_gettop (L);
+}
+
 /* Container marshaller function. */
 static int
 marshal_container_marshaller (lua_State *L)
@@ -1627,12 +2060,12 @@ marshal_container_marshaller (lua_State *L)
 		lua_pop (L, 1);
 	      }
 	    marshal_2lua_array (L, *ti, GI_DIRECTION_OUT, atype, transfer,
-				data, size, 0);
+				data, size, 0, *lgi_marshal_buffers (L));
 	  }
 	else
 	  {
 	    nret = marshal_2c_array (L, *ti, atype, &data, &size, 3, FALSE,
-				     transfer);
+				     transfer, TRUE);
 	    if (lua_type (L, 2) == LUA_TTABLE)
 	      {
 		lua_pushinteger (L, size);
@@ -1832,13 +2265,35 @@ marshal_callback (lua_State *L)
   else
     {
       ci = lgi_udata_test (L, 1, LGI_GI_INFO);
-      lgi_callable_create (L, *ci, NULL);
+      lgi_callable_create_cached (L, *ci);
     }
   addr = lgi_closure_create (L, user_data, 2, FALSE);
   lua_pushlightuserdata (L, addr);
   return 2;
 }
 
+/* Creates closure for Lua override of the virtual method.  Lua
+   prototype: guard, addr = core.marshal.vfunc(callback_info, target) */
+static int
+marshal_vfunc (lua_State *L)
+{
+  gpointer user_data, addr;
+  GICallableInfo **ci;
+
+  user_data = lgi_closure_allocate (L, 1);
+  *lgi_guard_create (L, lgi_closure_destroy) = user_data;
+  if (lua_istable (L, 1))
+    lgi_callable_parse (L, 1, NULL);
+  else
+    {
+      ci = luaL_checkudata (L, 1, LGI_GI_INFO);
+      lgi_callable_create_cached (L, *ci);
+    }
+  addr = lgi_closure_create_vfunc (L, user_data, 2);
+  lua_pushlightuserdata (L, addr);
+  return 2;
+}
+
 static void
 gclosure_destroy (gpointer user_data, GClosure *closure)
 {
@@ -1910,63 +2365,1791 @@ marshal_closure_set_marshal (lua_State *L)
   return 0;
 }
 
-/* Calculates size and alignment of specified type.
-   size, align = marshal.typeinfo(tiinfo) */
-static int
-marshal_typeinfo (lua_State *L)
+/* Data of GClosures invoking Lua targets.  All such closures share
+   single marshal function, marshal_closure_marshal(), so that no
+   ffi closure has to be created for each of them. */
+typedef struct _LuaClosureData
 {
-  GIBaseInfo **info = luaL_checkudata (L, 1, LGI_GI_INFO);
-  switch (g_type_info_get_tag (*info))
+  /* Lua thread in which the target is invoked and its reference. */
+  lua_State *L;
+  int thread_ref;
+
+  /* State lock, to be passed to lgi_state_enter() when the closure is
+     invoked. */
+  gpointer state_lock;
+
+  /* References to invoked target and to compiled CallInfo table;
+     LUA_NOREF if the closure has no CallInfo. */
+  int target_ref;
+  int call_info_ref;
+
+  /* Object owning the closure; when set, the target is stored in the
+     slot of the owner's proxy instead of target_ref.  The owner is
+     held by weak reference, which clears it when the owner is
+     finalized. */
+  GObject *owner;
+} LuaClosureData;
+
+/* Arguments of single closure invocation, passed to the protected
+   marshal_closure_call(). */
+typedef struct _LuaClosureCall
+{
+  LuaClosureData *data;
+  GValue *return_value;
+  guint n_param_values;
+  const GValue *param_values;
+} LuaClosureCall;
+
+/* Pushes contents of simple GValue to the stack. */
+gboolean
+lgi_marshal_value_2lua (lua_State *L, const GValue *value)
+{
+  switch (G_TYPE_FUNDAMENTAL (G_VALUE_TYPE (value)))
     {
-#define HANDLE_INT(upper, type)						\
-      case GI_TYPE_TAG_ ## upper:					\
-	{								\
-	  struct Test { char offender; type examined; };		\
-	  lua_pushinteger (L, sizeof (type));				\
-	  lua_pushinteger (L, G_STRUCT_OFFSET (struct Test, examined));	\
-	}								\
-	break
+    case G_TYPE_BOOLEAN:
+      lua_pushboolean (L, g_value_get_boolean (value));
+      break;
 
-      HANDLE_INT (VOID, gpointer);
-      HANDLE_INT (BOOLEAN, gboolean);
-      HANDLE_INT (INT8, gint8);
-      HANDLE_INT (UINT8, guint8);
-      HANDLE_INT (INT16, gint16);
-      HANDLE_INT (UINT16, guint16);
-      HANDLE_INT (INT32, gint32);
-      HANDLE_INT (UINT32, guint32);
-      HANDLE_INT (INT64, gint64);
-      HANDLE_INT (UINT64, guint64);
-      HANDLE_INT (FLOAT, gfloat);
-      HANDLE_INT (DOUBLE, gdouble);
-      HANDLE_INT (GTYPE, GType);
-      HANDLE_INT (UTF8, const gchar *);
-      HANDLE_INT (FILENAME, const gchar *);
-      HANDLE_INT (UNICHAR, gunichar);
+#define HANDLE_INT(gtype, getter)			\
+      case G_TYPE_ ## gtype:				\
+	lua_pushinteger (L, g_value_get_ ## getter (value));	\
+	break
 
+      HANDLE_INT (CHAR, schar);
+      HANDLE_INT (UCHAR, uchar);
+      HANDLE_INT (INT, int);
+      HANDLE_INT (UINT, uint);
+      HANDLE_INT (LONG, long);
+      HANDLE_INT (ULONG, ulong);
+      HANDLE_INT (INT64, int64);
+      HANDLE_INT (UINT64, uint64);
 #undef HANDLE_INT
 
+    case G_TYPE_ENUM:
+    case G_TYPE_FLAGS:
+      /* Enums and flags are represented symbolically, so their
+	 repotable must be known. */
+      lgi_type_get_repotype (L, G_VALUE_TYPE (value), NULL);
+      if (lua_isnil (L, -1))
+	{
+	  lua_pop (L, 1);
+	  return FALSE;
+	}
+      if (G_VALUE_HOLDS_ENUM (value))
+	lua_pushinteger (L, g_value_get_enum (value));
+      else
+	lua_pushinteger (L, g_value_get_flags (value));
+      marshal_2lua_enum_value (L);
+      lua_remove (L, -2);
+      break;
+
+    case G_TYPE_FLOAT:
+      lua_pushnumber (L, g_value_get_float (value));
+      break;
+
+    case G_TYPE_DOUBLE:
+      lua_pushnumber (L, g_value_get_double (value));
+      break;
+
+    case G_TYPE_STRING:
+      lua_pushstring (L, g_value_get_string (value));
+      break;
+
+    case G_TYPE_OBJECT:
+      lgi_object_2lua (L, g_value_get_object (value), FALSE, FALSE);
+      break;
+
+    case G_TYPE_POINTER:
+      lua_pushlightuserdata (L, g_value_get_pointer (value));
+      break;
+
+    case G_TYPE_BOXED:
+    case G_TYPE_VARIANT:
+      /* GStrv is marshalled as an array by its Value marshaller. */
+      if (G_VALUE_TYPE (value) == G_TYPE_STRV)
+	return FALSE;
+      lgi_type_get_repotype (L, G_VALUE_TYPE (value), NULL);
+      if (lua_isnil (L, -1))
+	{
+	  lua_pop (L, 1);
+	  return FALSE;
+	}
+      lgi_record_2lua (L, G_VALUE_HOLDS_VARIANT (value)
+		       ? (gpointer) g_value_get_variant (value)
+		       : g_value_get_boxed (value), FALSE, 0);
+      break;
+
     default:
-      return luaL_argerror (L, 1, "bad typeinfo");
+      return FALSE;
     }
 
-  return 2;
+  return TRUE;
 }
 
-static const struct luaL_Reg marshal_api_reg[] = {
-  { "container", marshal_container },
-  { "fundamental", marshal_fundamental },
-  { "argument", marshal_argument },
-  { "callback", marshal_callback },
-  { "closure_set_marshal", marshal_closure_set_marshal },
-  { "closure_invoke", marshal_closure_invoke },
-  { "typeinfo", marshal_typeinfo },
-  { NULL, NULL }
-};
-
-void
-lgi_marshal_init (lua_State *L)
+/* Stores Lua value into simple GValue. */
+gboolean
+lgi_marshal_value_2c (lua_State *L, int narg, GValue *value)
 {
+  int type = lua_type (L, narg);
+  lgi_makeabs (L, narg);
+  switch (G_TYPE_FUNDAMENTAL (G_VALUE_TYPE (value)))
+    {
+    case G_TYPE_BOOLEAN:
+      g_value_set_boolean (value, lua_toboolean (L, narg));
+      break;
+
+#define HANDLE_INT(gtype, setter, val_min, val_max)			\
+      case G_TYPE_ ## gtype:						\
+	if (type != LUA_TNUMBER)					\
+	  return FALSE;							\
+	g_value_set_ ## setter (value,					\
+				check_integer (L, narg, val_min, val_max)); \
+	break
+
+      HANDLE_INT (CHAR, schar, G_MININT8, G_MAXINT8);
+      HANDLE_INT (UCHAR, uchar, 0, G_MAXUINT8);
+      HANDLE_INT (INT, int, G_MININT, G_MAXINT);
+      HANDLE_INT (UINT, uint, 0, G_MAXUINT);
+      HANDLE_INT (LONG, long, G_MINLONG, G_MAXLONG);
+#if LUA_VERSION_NUM >= 503
+      HANDLE_INT (ULONG, ulong, 0, (sizeof (gulong) < sizeof (lua_Integer)
+				    ? G_MAXULONG : LUA_MAXINTEGER));
+      HANDLE_INT (INT64, int64, LUA_MININTEGER, LUA_MAXINTEGER);
+      HANDLE_INT (UINT64, uint64, 0, LUA_MAXINTEGER);
+#else
+      HANDLE_INT (ULONG, ulong, 0, G_MAXULONG);
+      HANDLE_INT (INT64, int64, ((lua_Number) -0x7f00000000000000LL) - 1,
+		  0x7fffffffffffffffLL);
+      HANDLE_INT (UINT64, uint64, 0, 0xffffffffffffffffULL);
+#endif
+#undef HANDLE_INT
+
+    case G_TYPE_ENUM:
+    case G_TYPE_FLAGS:
+      if (type == LUA_TNUMBER)
+	lua_pushvalue (L, narg);
+      else
+	{
+	  lgi_type_get_repotype (L, G_VALUE_TYPE (value), NULL);
+	  if (lua_isnil (L, -1))
+	    {
+	      lua_pop (L, 1);
+	      return FALSE;
+	    }
+	  marshal_2c_enum_value (L, narg);
+	}
+
+      /* Leave values which do not convert to a number (e.g. unknown
+	 symbols) to the Lua marshaller, which reports the error. */
+      if (lua_type (L, -1) != LUA_TNUMBER)
+	{
+	  lua_pop (L, 1);
+	  return FALSE;
+	}
+      if (G_VALUE_HOLDS_ENUM (value))
+	g_value_set_enum (value, lua_tointeger (L, -1));
+      else
+	g_value_set_flags (value, (guint) lua_tonumber (L, -1));
+      lua_pop (L, 1);
+      break;
+
+    case G_TYPE_FLOAT:
+      if (type != LUA_TNUMBER)
+	return FALSE;
+      g_value_set_float (value, lua_tonumber (L, narg));
+      break;
+
+    case G_TYPE_DOUBLE:
+      if (type != LUA_TNUMBER)
+	return FALSE;
+      g_value_set_double (value, lua_tonumber (L, narg));
+      break;
+
+    case G_TYPE_STRING:
+      if (type != LUA_TSTRING && type != LUA_TNIL)
+	return FALSE;
+      g_value_set_string (value, lua_tostring (L, narg));
+      break;
+
+    case G_TYPE_OBJECT:
+      {
+	gpointer obj = lgi_object_2c (L, narg, G_VALUE_TYPE (value),
+				      TRUE, TRUE, FALSE);
+	if (obj == NULL && type != LUA_TNIL)
+	  return FALSE;
+	g_value_set_object (value, obj);
+	break;
+      }
+
+    case G_TYPE_POINTER:
+      if (type != LUA_TLIGHTUSERDATA && type != LUA_TNIL)
+	return FALSE;
+      g_value_set_pointer (value, lua_touserdata (L, narg));
+      break;
+
+    case G_TYPE_BOXED:
+    case G_TYPE_VARIANT:
+      {
+	gpointer addr;
+	if (G_VALUE_TYPE (value) == G_TYPE_STRV)
+	  return FALSE;
+	lgi_type_get_repotype (L, G_VALUE_TYPE (value), NULL);
+	if (lua_isnil (L, -1))
+	  {
+	    lua_pop (L, 1);
+	    return FALSE;
+	  }
+	lgi_record_2c (L, narg, &addr, FALSE, FALSE, TRUE, TRUE);
+	if (addr == NULL && type != LUA_TNIL)
+	  return FALSE;
+	if (G_VALUE_HOLDS_VARIANT (value))
+	  g_value_set_variant (value, addr);
+	else
+	  g_value_set_boxed (value, addr);
+	break;
+      }
+
+    default:
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Native GObject.Value marshaller, handling values of fundamental
+   types directly and forwarding the rest to the Lua marshaller stored
+   in the upvalue.  Signature is the same as of Value marshallers:
+   value = marshaller(gvalue, params) or marshaller(gvalue, params, value) */
+static int
+marshal_value_marshaller (lua_State *L)
+{
+  GValue *value;
+  lgi_type_get_repotype (L, G_TYPE_VALUE, NULL);
+  lgi_record_2c (L, 1, &value, FALSE, FALSE, FALSE, FALSE);
+  if (lua_isnone (L, 3))
+    {
+      if (lgi_marshal_value_2lua (L, value))
+	return 1;
+    }
+  else if (lgi_marshal_value_2c (L, 3, value))
+    return 0;
+
+  /* Fall back to the Lua marshaller. */
+  lua_pushvalue (L, lua_upvalueindex (1));
+  lua_insert (L, 1);
+  lua_call (L, lua_gettop (L) - 1, LUA_MULTRET);
+  return lua_gettop (L);
+}
+
+/* Creates native Value marshaller, falling back to given Lua
+   marshaller for values which cannot be marshalled natively.
+   Signature is:
+   marshaller = marshal.value(fallback_marshaller) */
+static int
+marshal_value (lua_State *L)
+{
+  luaL_checkany (L, 1);
+  lua_settop (L, 1);
+  lua_pushcclosure (L, marshal_value_marshaller, 1);
+  return 1;
+}
+
+/* Pushes GObject.Value record proxy for given value. */
+static void
+marshal_closure_value_record (lua_State *L, const GValue *value)
+{
+  lgi_type_get_repotype (L, G_TYPE_VALUE, NULL);
+  lgi_record_2lua (L, (gpointer) value, FALSE, 0);
+}
+
+/* Performs the invocation of the closure, called in protected mode.
+   Parameters are marshalled using CallInfo cell marshallers, unless
+   they are of simple fundamental type; closures without CallInfo
+   marshal everything according to actual GValue types. */
+static int
+marshal_closure_call (lua_State *L)
+{
+  LuaClosureCall *call = lua_touserdata (L, 1);
+  guint i, cells;
+  int narg = 0;
+
+  luaL_checkstack (L, call->n_param_values + 5, "");
+  lua_rawgeti (L, LUA_REGISTRYINDEX, call->data->call_info_ref);
+  if (call->data->owner != NULL)
+    lgi_object_get_slot (L, call->data->owner, call->data);
+  else
+    lua_rawgeti (L, LUA_REGISTRYINDEX, call->data->target_ref);
+  if (lua_isnil (L, 3))
+    /* Owner's proxy is already gone, the object is being destroyed. */
+    return 0;
+
+  cells = lua_isnil (L, 2) ? call->n_param_values : lua_objlen (L, 2);
+  for (i = 0; i < call->n_param_values && i < cells; i++)
+    {
+      const GValue *value = &call->param_values[i];
+      if (lua_isnil (L, 2))
+	{
+	  if (!lgi_marshal_value_2lua (L, value))
+	    {
+	      marshal_closure_value_record (L, value);
+	      lua_getfield (L, -1, "value");
+	      lua_replace (L, -2);
+	    }
+	  narg++;
+	  continue;
+	}
+
+      /* Skip cells which do not produce any Lua argument. */
+      lua_rawgeti (L, 2, i + 1);
+      lua_getfield (L, -1, "internal");
+      lua_getfield (L, -2, "to_lua");
+      if (lua_toboolean (L, -2) || lua_isnil (L, -1))
+	{
+	  lua_pop (L, 3);
+	  continue;
+	}
+
+      if (lgi_marshal_value_2lua (L, value))
+	{
+	  lua_replace (L, -4);
+	  lua_pop (L, 2);
+	}
+      else
+	{
+	  marshal_closure_value_record (L, value);
+	  lua_call (L, 1, 1);
+	  lua_replace (L, -3);
+	  lua_pop (L, 1);
+	}
+      narg++;
+    }
+
+  /* Invoke the target. */
+  lua_call (L, narg, 1);
+
+  /* Marshal the return value, if requested. */
+  if (call->return_value && G_VALUE_TYPE (call->return_value))
+    {
+      if (lua_isnil (L, 2))
+	{
+	  if (!lgi_marshal_value_2c (L, 3, call->return_value))
+	    {
+	      marshal_closure_value_record (L, call->return_value);
+	      lua_pushvalue (L, 3);
+	      lua_setfield (L, -2, "value");
+	    }
+	}
+      else
+	{
+	  lua_getfield (L, 2, "ret");
+	  if (!lua_isnil (L, -1)
+	      && !lgi_marshal_value_2c (L, 3, call->return_value))
+	    {
+	      lua_getfield (L, -1, "to_value");
+	      marshal_closure_value_record (L, call->return_value);
+	      lua_pushnil (L);
+	      lua_pushvalue (L, 3);
+	      lua_call (L, 3, 0);
+	    }
+	}
+    }
+
+  return 0;
+}
+
+/* Marshal function shared by all closures with Lua targets. */
+static void
+marshal_closure_marshal (GClosure *closure, GValue *return_value,
+			 guint n_param_values, const GValue *param_values,
+			 gpointer invocation_hint, gpointer marshal_data)
+{
+  LuaClosureData *data = closure->data;
+  LuaClosureCall call;
+  lua_State *L;
+  int stacktop;
+  (void) invocation_hint;
+  (void) marshal_data;
+
+  /* Get access to proper Lua context. */
+  lgi_state_enter (data->state_lock);
+  lua_rawgeti (data->L, LUA_REGISTRYINDEX, data->thread_ref);
+  L = lua_tothread (data->L, -1);
+  if (lua_status (L) != 0)
+    {
+      /* Thread is suspended and we cannot resume it, so create new
+	 thread and switch the closure to its context. */
+      lua_State *newL = lua_newthread (L);
+      lua_rawseti (L, LUA_REGISTRYINDEX, data->thread_ref);
+      L = newL;
+    }
+  lua_pop (data->L, 1);
+  data->L = L;
+
+  /* Perform the call in protected mode, errors cannot be propagated
+     to the C code invoking the closure. */
+  stacktop = lua_gettop (L);
+  call.data = data;
+  call.return_value = return_value;
+  call.n_param_values = n_param_values;
+  call.param_values = param_values;
+  lua_pushcfunction (L, marshal_closure_call);
+  lua_pushlightuserdata (L, &call);
+  if (lua_pcall (L, 1, 0, 0) != 0)
+    g_warning ("Error raised while calling closure: %s",
+	       lua_tostring (L, -1));
+
+  lua_settop (L, stacktop);
+  lgi_state_leave (data->state_lock);
+}
+
+/* Forgets the owner of the closure when the owner is finalized. */
+static void
+marshal_closure_owner_gone (gpointer user_data, GObject *owner)
+{
+  LuaClosureData *data = user_data;
+  (void) owner;
+  lgi_state_enter (data->state_lock);
+  data->owner = NULL;
+  lgi_state_leave (data->state_lock);
+}
+
+/* Releases Lua references held by the closure, so that the target is
+   not kept alive by invalidated closures. */
+static void
+marshal_closure_invalidate (gpointer user_data, GClosure *closure)
+{
+  LuaClosureData *data = user_data;
+  (void) closure;
+  lgi_state_enter (data->state_lock);
+  if (data->owner != NULL)
+    {
+      lua_pushnil (data->L);
+      lgi_object_set_slot (data->L, data->owner, data);
+      g_object_weak_unref (data->owner, marshal_closure_owner_gone, data);
+      data->owner = NULL;
+    }
+  luaL_unref (data->L, LUA_REGISTRYINDEX, data->target_ref);
+  luaL_unref (data->L, LUA_REGISTRYINDEX, data->call_info_ref);
+  data->target_ref = data->call_info_ref = LUA_NOREF;
+  lgi_state_leave (data->state_lock);
+}
+
+static void
+marshal_closure_finalize (gpointer user_data, GClosure *closure)
+{
+  LuaClosureData *data = user_data;
+  (void) closure;
+  lgi_state_enter (data->state_lock);
+  luaL_unref (data->L, LUA_REGISTRYINDEX, data->thread_ref);
+  lgi_state_leave (data->state_lock);
+  g_free (data);
+}
+
+/* Sets up closure to invoke Lua target using shared native marshal
+   function.  Signature is:
+   marshal.closure_set_target(closure, target[, call_info]) */
+static int
+marshal_closure_set_target (lua_State *L)
+{
+  GClosure *closure;
+  LuaClosureData *data;
+
+  lgi_type_get_repotype (L, G_TYPE_CLOSURE, NULL);
+  lgi_record_2c (L, 1, &closure, FALSE, FALSE, FALSE, FALSE);
+  luaL_checkany (L, 2);
+
+  data = g_new (LuaClosureData, 1);
+  data->L = L;
+  lua_pushthread (L);
+  data->thread_ref = luaL_ref (L, LUA_REGISTRYINDEX);
+  data->state_lock = lgi_state_get_lock (L);
+  lua_pushvalue (L, 2);
+  data->target_ref = luaL_ref (L, LUA_REGISTRYINDEX);
+  if (lua_isnoneornil (L, 3))
+    data->call_info_ref = LUA_NOREF;
+  else
+    {
+      luaL_checktype (L, 3, LUA_TTABLE);
+      lua_pushvalue (L, 3);
+      data->call_info_ref = luaL_ref (L, LUA_REGISTRYINDEX);
+    }
+  data->owner = NULL;
+
+  closure->data = data;
+  g_closure_set_marshal (closure, marshal_closure_marshal);
+  g_closure_add_invalidate_notifier (closure, data,
+				     marshal_closure_invalidate);
+  g_closure_add_finalize_notifier (closure, data, marshal_closure_finalize);
+  return 0;
+}
+
+/* Makes the object owner of the closure, so that the target of the
+   closure is kept alive by the object's proxy instead of the registry
+   and reference cycles between the object and its handlers can be
+   collected.  Intended only for closures created for single
+   connection to the owner's signal; closures not created by
+   closure_set_target or already owned are left intact.  Signature is:
+   marshal.closure_set_owner(closure, object) */
+static int
+marshal_closure_set_owner (lua_State *L)
+{
+  GClosure *closure;
+  LuaClosureData *data;
+  gpointer owner;
+
+  lgi_type_get_repotype (L, G_TYPE_CLOSURE, NULL);
+  lgi_record_2c (L, 1, &closure, FALSE, FALSE, FALSE, FALSE);
+  owner = lgi_object_2c (L, 2, G_TYPE_INVALID, FALSE, TRUE, FALSE);
+  if (closure->marshal != marshal_closure_marshal || !G_IS_OBJECT (owner))
+    return 0;
+
+  data = closure->data;
+  if (data->owner != NULL || data->target_ref == LUA_NOREF)
+    return 0;
+
+  /* Move the target into the slot of the owner. */
+  lua_rawgeti (L, LUA_REGISTRYINDEX, data->target_ref);
+  if (lgi_object_set_slot (L, owner, data))
+    {
+      luaL_unref (L, LUA_REGISTRYINDEX, data->target_ref);
+      data->target_ref = LUA_NOREF;
+      data->owner = owner;
+      g_object_weak_ref (owner, marshal_closure_owner_gone, data);
+    }
+  return 0;
+}
+
+/* State of compiled property accessor; pspec found in the class of
+   the last accessed object. */
+typedef struct _PropertyAccessor
+{
+  GObjectClass *klass;
+  GParamSpec *pspec;
+} PropertyAccessor;
+
+/* Raises error about property access mode of given object. */
+static int
+marshal_property_error (lua_State *L, GObject *object, const char *name,
+			const char *mode)
+{
+  lgi_type_get_repotype (L, G_OBJECT_TYPE (object), NULL);
+  if (!lua_isnil (L, -1))
+    lua_getfield (L, -1, "_name");
+  return luaL_error (L, "%s: `%s' not %s",
+		     lua_isstring (L, -1) ? lua_tostring (L, -1)
+		     : G_OBJECT_TYPE_NAME (object), name, mode);
+}
+
+/* Property accessor closure; upvalues are PropertyAccessor userdata,
+   property name and Lua marshaller used for values which cannot be
+   marshalled natively.  Signature is:
+   value = accessor(object) or accessor(object, value) */
+static int
+marshal_property_access (lua_State *L)
+{
+  PropertyAccessor *accessor = lua_touserdata (L, lua_upvalueindex (1));
+  const char *name = lua_tostring (L, lua_upvalueindex (2));
+  gboolean set = !lua_isnone (L, 2);
+  GObject *object;
+  GObjectClass *klass;
+  GValue scratch, *value;
+
+  object = lgi_object_2c (L, 1, G_TYPE_OBJECT, FALSE, FALSE, FALSE);
+  klass = G_OBJECT_GET_CLASS (object);
+  if (accessor->klass != klass)
+    {
+      /* Lookup pspec in the class of the object. */
+      accessor->pspec = g_object_class_find_property (klass, name);
+      if (accessor->pspec == NULL)
+	return luaL_error (L, "%s: no property `%s'",
+			   G_OBJECT_TYPE_NAME (object), name);
+      accessor->klass = klass;
+    }
+
+  if (!(accessor->pspec->flags & (set ? G_PARAM_WRITABLE : G_PARAM_READABLE)))
+    return marshal_property_error (L, object, name,
+				   set ? "writable" : "readable");
+
+  /* Try to use scratch value on the C stack first, fall back to Value
+     record and Lua marshaller if the value is not simple enough. */
+  memset (&scratch, 0, sizeof (scratch));
+  g_value_init (&scratch, G_PARAM_SPEC_VALUE_TYPE (accessor->pspec));
+  if (set)
+    {
+      if (lgi_marshal_value_2c (L, 2, &scratch))
+	value = &scratch;
+      else
+	{
+	  g_value_unset (&scratch);
+	  lgi_type_get_repotype (L, G_TYPE_VALUE, NULL);
+	  value = lgi_record_new (L, 1, FALSE);
+	  g_value_init (value, G_PARAM_SPEC_VALUE_TYPE (accessor->pspec));
+	  lua_pushvalue (L, lua_upvalueindex (3));
+	  lua_pushvalue (L, -2);
+	  lua_pushnil (L);
+	  lua_pushvalue (L, 2);
+	  lua_call (L, 3, 0);
+	}
+      g_object_set_property (object, accessor->pspec->name, value);
+      if (value == &scratch)
+	g_value_unset (&scratch);
+      return 0;
+    }
+  else
+    {
+      g_object_get_property (object, accessor->pspec->name, &scratch);
+      if (!lgi_marshal_value_2lua (L, &scratch))
+	{
+	  lua_pushvalue (L, lua_upvalueindex (3));
+	  lgi_type_get_repotype (L, G_TYPE_VALUE, NULL);
+	  value = lgi_record_new (L, 1, FALSE);
+	  g_value_init (value, G_VALUE_TYPE (&scratch));
+	  g_value_copy (&scratch, value);
+	  g_value_unset (&scratch);
+	  lua_call (L, 1, 1);
+	}
+      else
+	g_value_unset (&scratch);
+      return 1;
+    }
+}
+
+/* Creates compiled property accessor.  Signature is:
+   accessor = marshal.property(name, marshaller) */
+static int
+marshal_property (lua_State *L)
+{
+  PropertyAccessor *accessor;
+  luaL_checkstring (L, 1);
+  luaL_checkany (L, 2);
+  accessor = lua_newuserdata (L, sizeof (PropertyAccessor));
+  accessor->klass = NULL;
+  accessor->pspec = NULL;
+  lua_pushvalue (L, 1);
+  lua_pushvalue (L, 2);
+  lua_pushcclosure (L, marshal_property_access, 3);
+  return 1;
+}
+
+/* Calculates size and alignment of specified type.
+   size, align = marshal.typeinfo(tiinfo) */
+static int
+marshal_typeinfo (lua_State *L)
+{
+  GIBaseInfo **info = luaL_checkudata (L, 1, LGI_GI_INFO);
+  switch (g_type_info_get_tag (*info))
+    {
+#define HANDLE_INT(upper, type)						\
+      case GI_TYPE_TAG_ ## upper:					\
+	{								\
+	  struct Test { char offender; type examined; };		\
+	  lua_pushinteger (L, sizeof (type));				\
+	  lua_pushinteger (L, G_STRUCT_OFFSET (struct Test, examined));	\
+	}								\
+	break
+
+      HANDLE_INT (VOID, gpointer);
+      HANDLE_INT (BOOLEAN, gboolean);
+      HANDLE_INT (INT8, gint8);
+      HANDLE_INT (UINT8, guint8);
+      HANDLE_INT (INT16, gint16);
+      HANDLE_INT (UINT16, guint16);
+      HANDLE_INT (INT32, gint32);
+      HANDLE_INT (UINT32, guint32);
+      HANDLE_INT (INT64, gint64);
+      HANDLE_INT (UINT64, guint64);
+      HANDLE_INT (FLOAT, gfloat);
+      HANDLE_INT (DOUBLE, gdouble);
+      HANDLE_INT (GTYPE, GType);
+      HANDLE_INT (UTF8, const gchar *);
+      HANDLE_INT (FILENAME, const gchar *);
+      HANDLE_INT (UNICHAR, gunichar);
+
+#undef HANDLE_INT
+
+    default:
+      return luaL_argerror (L, 1, "bad typeinfo");
+    }
+
+  return 2;
+}
+
+/* Returns size of the element of fixed-size numeric array with given
+   element type character, or 0 if arrays of such type are not
+   converted in bulk. */
+static gsize
+variant_fixed_size (gchar tag)
+{
+  switch (tag)
+    {
+    case 'y':
+      return 1;
+    case 'n':
+    case 'q':
+      return 2;
+    case 'i':
+    case 'u':
+      return 4;
+    case 'x':
+    case 't':
+    case 'd':
+      return 8;
+    default:
+      return 0;
+    }
+}
+
+/* Gets GVariant from GLib.Variant proxy at narg. */
+static GVariant *
+variant_check (lua_State *L, int narg)
+{
+  GVariant *variant;
+  lgi_type_get_repotype (L, G_TYPE_VARIANT, NULL);
+  lgi_record_2c (L, narg, &variant, FALSE, FALSE, FALSE, FALSE);
+  return variant;
+}
+
+/* Gets length of the Lua array at narg, honoring its 'n' field. */
+static gsize
+variant_array_length (lua_State *L, int narg)
+{
+  gsize length;
+  lua_getfield (L, narg, "n");
+  if (lua_isnumber (L, -1))
+    {
+      lua_Number n = lua_tonumber (L, -1);
+      if (!(n >= 0 && n < (lua_Number) G_MAXSIZE))
+	luaL_error (L, "variant array: invalid length %f", (double) n);
+      length = (gsize) n;
+    }
+  else
+    length = lua_objlen (L, narg);
+  lua_pop (L, 1);
+  return length;
+}
+
+/* Creates floating array variant with fixed-size numeric elements from
+   Lua array at narg.  Byte arrays are accepted also as Lua strings or
+   'bytes' buffers. */
+static GVariant *
+variant_new_fixed_array (lua_State *L, const GVariantType *element,
+			 int narg)
+{
+  gchar tag = *g_variant_type_peek_string (element);
+  gsize size = variant_fixed_size (tag), length, i;
+  gpointer *guard, data;
+  GVariant *variant;
+
+  if (tag == 'y')
+    {
+      gconstpointer bytes = (lua_type (L, narg) == LUA_TSTRING)
+	? lua_tolstring (L, narg, &length)
+	: lgi_buffer_test (L, narg, &length);
+      if (bytes != NULL)
+	return g_variant_new_fixed_array (element, bytes, length, 1);
+    }
+
+  /* Collect elements into temporary guarded block. */
+  length = variant_array_length (L, narg);
+  if (length > G_MAXSIZE / size)
+    luaL_error (L, "variant array: length %f too large", (double) length);
+  guard = lgi_guard_create (L, g_free);
+  data = *guard = g_malloc_n (length, size);
+  for (i = 0; i < length; i++)
+    {
+      GIArgument arg;
+      lua_pushinteger (L, i + 1);
+      lua_gettable (L, narg);
+      switch (tag)
+	{
+#define HANDLE_INT(c, tagname, field)					\
+	  case c:							\
+	    marshal_2c_int (L, GI_TYPE_TAG_ ## tagname, &arg, lua_gettop (L), \
+			    FALSE, 0);					\
+	    ((g ## field *) data)[i] = arg.v_ ## field;			\
+	    break
+
+	  HANDLE_INT ('y', UINT8, uint8);
+	  HANDLE_INT ('n', INT16, int16);
+	  HANDLE_INT ('q', UINT16, uint16);
+	  HANDLE_INT ('i', INT32, int32);
+	  HANDLE_INT ('u', UINT32, uint32);
+	  HANDLE_INT ('x', INT64, int64);
+	  HANDLE_INT ('t', UINT64, uint64);
+#undef HANDLE_INT
+
+	case 'd':
+	  ((gdouble *) data)[i] = luaL_checknumber (L, -1);
+	  break;
+	}
+      lua_pop (L, 1);
+    }
+
+  variant = g_variant_new_fixed_array (element, data, length, size);
+  g_free (data);
+  *guard = NULL;
+  lua_pop (L, 1);
+  return variant;
+}
+
+/* Creates floating variant of basic type, variant type or array of
+   fixed-size numbers from Lua value at narg.  Returns NULL for other
+   container types. */
+static GVariant *
+variant_new_leaf (lua_State *L, const GVariantType *type, int narg)
+{
+  const gchar *format = g_variant_type_peek_string (type);
+  GIArgument arg;
+  switch (format[0])
+    {
+    case 'b':
+      return g_variant_new_boolean (lua_toboolean (L, narg));
+
+#define HANDLE_INT(c, tagname, field, name)				\
+      case c:								\
+	marshal_2c_int (L, GI_TYPE_TAG_ ## tagname, &arg, narg, FALSE, 0); \
+	return g_variant_new_ ## name (arg.v_ ## field)
+
+      HANDLE_INT ('y', UINT8, uint8, byte);
+      HANDLE_INT ('n', INT16, int16, int16);
+      HANDLE_INT ('q', UINT16, uint16, uint16);
+      HANDLE_INT ('i', INT32, int32, int32);
+      HANDLE_INT ('u', UINT32, uint32, uint32);
+      HANDLE_INT ('x', INT64, int64, int64);
+      HANDLE_INT ('t', UINT64, uint64, uint64);
+      HANDLE_INT ('h', INT32, int32, handle);
+#undef HANDLE_INT
+
+    case 'd':
+      return g_variant_new_double (luaL_checknumber (L, narg));
+
+    case 's':
+    case 'o':
+    case 'g':
+      {
+	const gchar *str = luaL_checkstring (L, narg);
+	if (format[0] == 's' ? !g_utf8_validate (str, -1, NULL)
+	    : format[0] == 'o' ? !g_variant_is_object_path (str)
+	    : !g_variant_is_signature (str))
+	  luaL_error (L, "Variant.new(`%c') - invalid source value",
+		      format[0]);
+	return (format[0] == 's') ? g_variant_new_string (str)
+	  : (format[0] == 'o') ? g_variant_new_object_path (str)
+	  : g_variant_new_signature (str);
+      }
+
+    case 'v':
+      return g_variant_new_variant (variant_check (L, narg));
+
+    case 'a':
+      if (variant_fixed_size (format[1]) != 0)
+	return variant_new_fixed_array (L, g_variant_type_element (type),
+					narg);
+      break;
+    }
+
+  return NULL;
+}
+
+static void
+variant_add_contents (lua_State *L, GVariantBuilder *builder,
+		      const GVariantType *type, int narg);
+
+/* Adds Lua value at narg converted to variant of given type to the
+   builder. */
+static void
+variant_add (lua_State *L, GVariantBuilder *builder,
+	     const GVariantType *type, int narg)
+{
+  GVariant *variant = variant_new_leaf (L, type, narg);
+  if (variant != NULL)
+    g_variant_builder_add_value (builder, variant);
+  else
+    {
+      g_variant_builder_open (builder, type);
+      variant_add_contents (L, builder, type, narg);
+      g_variant_builder_close (builder);
+    }
+}
+
+/* Adds children of container variant of given type, converted from
+   Lua value at narg, to the builder opened for that container. */
+static void
+variant_add_contents (lua_State *L, GVariantBuilder *builder,
+		      const GVariantType *type, int narg)
+{
+  const GVariantType *member;
+  gsize length, i;
+
+  luaL_checkstack (L, 4, "");
+  switch (*g_variant_type_peek_string (type))
+    {
+    case 'm':
+      if (lua_toboolean (L, narg))
+	variant_add (L, builder, g_variant_type_element (type), narg);
+      break;
+
+    case 'a':
+      member = g_variant_type_element (type);
+      if (g_variant_type_is_dict_entry (member))
+	{
+	  /* Dictionary is mapped to Lua table directly.  Convert copy
+	     of the key, so that lua_next() is not confused. */
+	  luaL_checktype (L, narg, LUA_TTABLE);
+	  lua_pushnil (L);
+	  while (lua_next (L, narg) != 0)
+	    {
+	      lua_pushvalue (L, -2);
+	      g_variant_builder_open (builder, member);
+	      variant_add (L, builder, g_variant_type_key (member),
+			   lua_gettop (L));
+	      variant_add (L, builder, g_variant_type_value (member),
+			   lua_gettop (L) - 1);
+	      g_variant_builder_close (builder);
+	      lua_pop (L, 2);
+	    }
+	}
+      else
+	{
+	  length = variant_array_length (L, narg);
+	  for (i = 1; i <= length; i++)
+	    {
+	      lua_pushinteger (L, i);
+	      lua_gettable (L, narg);
+	      variant_add (L, builder, member, lua_gettop (L));
+	      lua_pop (L, 1);
+	    }
+	}
+      break;
+
+    default:
+      /* Tuple or dictionary entry, members are taken from Lua array. */
+      for (member = g_variant_type_first (type), i = 1; member != NULL;
+	   member = g_variant_type_next (member), i++)
+	{
+	  lua_pushinteger (L, i);
+	  lua_gettable (L, narg);
+	  variant_add (L, builder, member, lua_gettop (L));
+	  lua_pop (L, 1);
+	}
+    }
+}
+
+/* Creates GLib.Variant of given type from Lua value.  Lua-side
+   prototype:
+   variant = core.marshal.variant_new(type, value) */
+static int
+marshal_variant_new (lua_State *L)
+{
+  const gchar *format = luaL_checkstring (L, 1), *end;
+  const GVariantType *type;
+  GVariant *variant;
+
+  /* Check that the type is a single definite type. */
+  if (!g_variant_type_string_scan (format, NULL, &end) || *end != '\0'
+      || strpbrk (format, "*?r") != NULL)
+    return luaL_error (L, "Variant.new(`%s') - invalid type", format);
+  type = G_VARIANT_TYPE (format);
+
+  lua_settop (L, 2);
+  variant = variant_new_leaf (L, type, 2);
+  if (variant == NULL)
+    {
+      /* Build the container in a guarded builder, so that partially
+	 built contents are released when an error is thrown. */
+      GVariantBuilder **builder = (GVariantBuilder **)
+	lgi_guard_create (L, (GDestroyNotify) g_variant_builder_unref);
+      *builder = g_variant_builder_new (type);
+      variant_add_contents (L, *builder, type, 2);
+      variant = g_variant_builder_end (*builder);
+      g_variant_builder_unref (*builder);
+      *builder = NULL;
+      lua_pop (L, 1);
+    }
+
+  /* Proxy sinks the floating reference. */
+  lgi_type_get_repotype (L, G_TYPE_VARIANT, NULL);
+  lgi_record_2lua (L, variant, FALSE, 0);
+  return 1;
+}
+
+static void
+variant_2lua (lua_State *L, GVariant *variant, int self, int dict);
+
+/* Pushes Lua value of the child variant and releases it. */
+static void
+variant_2lua_child (lua_State *L, GVariant *child, int dict)
+{
+  variant_2lua (L, child, 0, dict);
+  g_variant_unref (child);
+}
+
+/* Pushes Lua value of the variant.  Unless dict is 0, the value is
+   converted the same way as GLib.Variant 'value' attribute does;
+   arrays are left as variant proxies and dictionaries are converted
+   by the function at stack index dict.  If dict is 0, all values are
+   unpacked recursively into plain Lua values.  self is stack index of
+   existing proxy of the variant, or 0. */
+static void
+variant_2lua (lua_State *L, GVariant *variant, int self, int dict)
+{
+  const gchar *format = g_variant_get_type_string (variant);
+  gsize length, i;
+
+  luaL_checkstack (L, 4, "");
+  switch (format[0])
+    {
+    case 'b':
+      lua_pushboolean (L, g_variant_get_boolean (variant));
+      return;
+    case 'y':
+      lua_pushinteger (L, g_variant_get_byte (variant));
+      return;
+    case 'n':
+      lua_pushinteger (L, g_variant_get_int16 (variant));
+      return;
+    case 'q':
+      lua_pushinteger (L, g_variant_get_uint16 (variant));
+      return;
+    case 'i':
+      lua_pushinteger (L, g_variant_get_int32 (variant));
+      return;
+    case 'u':
+      lua_pushinteger (L, g_variant_get_uint32 (variant));
+      return;
+    case 'x':
+      lua_pushinteger (L, g_variant_get_int64 (variant));
+      return;
+    case 't':
+      lua_pushinteger (L, g_variant_get_uint64 (variant));
+      return;
+    case 'h':
+      if (dict != 0)
+	break;
+      lua_pushinteger (L, g_variant_get_handle (variant));
+      return;
+    case 'd':
+      lua_pushnumber (L, g_variant_get_double (variant));
+      return;
+    case 's':
+    case 'o':
+    case 'g':
+      lua_pushstring (L, g_variant_get_string (variant, NULL));
+      return;
+
+    case 'v':
+      if (dict != 0)
+	{
+	  lgi_type_get_repotype (L, G_TYPE_VARIANT, NULL);
+	  lgi_record_2lua (L, g_variant_get_variant (variant), TRUE, 0);
+	}
+      else
+	variant_2lua_child (L, g_variant_get_variant (variant), dict);
+      return;
+
+    case 'm':
+      if (g_variant_n_children (variant) == 0)
+	lua_pushnil (L);
+      else
+	{
+	  /* Maybe holding false unpacks to nil, the same as an empty
+	     one. */
+	  variant_2lua_child (L, g_variant_get_child_value (variant, 0), dict);
+	  if (lua_isboolean (L, -1) && !lua_toboolean (L, -1))
+	    {
+	      lua_pop (L, 1);
+	      lua_pushnil (L);
+	    }
+	}
+      return;
+
+    case '(':
+    case '{':
+      /* Unpack tuple or dictionary entry into array. */
+      length = g_variant_n_children (variant);
+      lua_createtable (L, length, 1);
+      for (i = 0; i < length; i++)
+	{
+	  variant_2lua_child (L, g_variant_get_child_value (variant, i),
+			      dict);
+	  lua_rawseti (L, -2, i + 1);
+	}
+      lua_pushinteger (L, length);
+      lua_setfield (L, -2, "n");
+      return;
+
+    case 'a':
+      if (format[1] == 'y')
+	{
+	  /* Bytestring is unpacked into Lua string. */
+	  gconstpointer data = g_variant_get_fixed_array (variant, &length, 1);
+	  lua_pushlstring (L, data, length);
+	  return;
+	}
+      else if (dict != 0)
+	{
+	  if (format[1] != '{')
+	    break;
+
+	  /* Dictionary is converted by the provided function. */
+	  lua_pushvalue (L, dict);
+	  if (self != 0)
+	    lua_pushvalue (L, self);
+	  else
+	    {
+	      lgi_type_get_repotype (L, G_TYPE_VARIANT, NULL);
+	      lgi_record_2lua (L, g_variant_ref (variant), TRUE, 0);
+	    }
+	  lua_call (L, 1, 1);
+	  return;
+	}
+      else if (format[1] == '{')
+	{
+	  /* Dictionary is unpacked into Lua table directly. */
+	  length = g_variant_n_children (variant);
+	  lua_createtable (L, 0, length);
+	  for (i = 0; i < length; i++)
+	    {
+	      GVariant *entry = g_variant_get_child_value (variant, i);
+	      variant_2lua_child (L, g_variant_get_child_value (entry, 0), 0);
+	      variant_2lua_child (L, g_variant_get_child_value (entry, 1), 0);
+	      g_variant_unref (entry);
+	      lua_rawset (L, -3);
+	    }
+	  return;
+	}
+      else if (variant_fixed_size (format[1]) != 0)
+	{
+	  /* Numeric arrays are unpacked in bulk. */
+	  gconstpointer data = g_variant_get_fixed_array (
+	    variant, &length, variant_fixed_size (format[1]));
+	  lua_createtable (L, length, 1);
+	  switch (format[1])
+	    {
+#define HANDLE_ELEMENT(c, ctype, push)				\
+	      case c:						\
+		for (i = 0; i < length; i++)			\
+		  {						\
+		    push (L, ((const ctype *) data)[i]);	\
+		    lua_rawseti (L, -2, i + 1);			\
+		  }						\
+		break
+
+	      HANDLE_ELEMENT ('n', gint16, lua_pushinteger);
+	      HANDLE_ELEMENT ('q', guint16, lua_pushinteger);
+	      HANDLE_ELEMENT ('i', gint32, lua_pushinteger);
+	      HANDLE_ELEMENT ('u', guint32, lua_pushinteger);
+	      HANDLE_ELEMENT ('x', gint64, lua_pushinteger);
+	      HANDLE_ELEMENT ('t', guint64, lua_pushinteger);
+	      HANDLE_ELEMENT ('d', gdouble, lua_pushnumber);
+#undef HANDLE_ELEMENT
+	    }
+	}
+      else
+	{
+	  /* Generic array is unpacked element by element. */
+	  length = g_variant_n_children (variant);
+	  lua_createtable (L, length, 1);
+	  for (i = 0; i < length; i++)
+	    {
+	      variant_2lua_child (L, g_variant_get_child_value (variant, i),
+				  0);
+	      lua_rawseti (L, -2, i + 1);
+	    }
+	}
+      lua_pushinteger (L, length);
+      lua_setfield (L, -2, "n");
+      return;
+    }
+
+  /* No simple unpacking is possible, return the variant itself. */
+  if (self != 0)
+    lua_pushvalue (L, self);
+  else
+    {
+      lgi_type_get_repotype (L, G_TYPE_VARIANT, NULL);
+      lgi_record_2lua (L, g_variant_ref (variant), TRUE, 0);
+    }
+}
+
+/* Converts variant to the nearest Lua value, leaving arrays intact.
+   Dictionaries are converted by given function.  Lua-side prototype:
+   value = core.marshal.variant_get(variant, dict) */
+static int
+marshal_variant_get (lua_State *L)
+{
+  GVariant *variant = variant_check (L, 1);
+  luaL_checktype (L, 2, LUA_TFUNCTION);
+  variant_2lua (L, variant, 1, 2);
+  return 1;
+}
+
+/* Unpacks variant recursively into plain Lua values.  Lua-side
+   prototype:
+   value = core.marshal.variant_unpack(variant) */
+static int
+marshal_variant_unpack (lua_State *L)
+{
+  variant_2lua (L, variant_check (L, 1), 1, 0);
+  return 1;
+}
+
+/* Converts index-th child of container variant the same way as
+   variant_get does, returns nothing if there is no such child.
+   Lua-side prototype:
+   value = core.marshal.variant_child(variant, index, dict) */
+static int
+marshal_variant_child (lua_State *L)
+{
+  GVariant *variant = variant_check (L, 1);
+  lua_Integer index = luaL_checkinteger (L, 2);
+  luaL_checktype (L, 3, LUA_TFUNCTION);
+  if (!g_variant_is_container (variant) || index < 1
+      || (gsize) index > g_variant_n_children (variant))
+    return 0;
+
+  variant_2lua_child (L, g_variant_get_child_value (variant, index - 1), 3);
+  return 1;
+}
+
+/* Converts key and value of index-th entry of the dictionary the same
+   way as variant_get does, returns nothing if there is no such entry.
+   If unbox is set, values of string-keyed dictionaries which are
+   variants are unboxed, consistently with variant_lookup.  Lua-side
+   prototype:
+   key, value = core.marshal.variant_entry(variant, index, dict[, unbox]) */
+static int
+marshal_variant_entry (lua_State *L)
+{
+  GVariant *variant = variant_check (L, 1), *entry, *value;
+  const gchar *format = g_variant_get_type_string (variant);
+  lua_Integer index = luaL_checkinteger (L, 2);
+  luaL_checktype (L, 3, LUA_TFUNCTION);
+  if (format[0] != 'a' || format[1] != '{' || index < 1
+      || (gsize) index > g_variant_n_children (variant))
+    return 0;
+
+  entry = g_variant_get_child_value (variant, index - 1);
+  variant_2lua_child (L, g_variant_get_child_value (entry, 0), 3);
+  value = g_variant_get_child_value (entry, 1);
+  if (lua_toboolean (L, 4) && format[2] == 's' && format[3] == 'v')
+    {
+      GVariant *boxed = value;
+      value = g_variant_get_variant (boxed);
+      g_variant_unref (boxed);
+    }
+  variant_2lua_child (L, value, 3);
+  g_variant_unref (entry);
+  return 2;
+}
+
+/* Finds entry with the key at narg in the dictionary variant and
+   returns new reference to its value, or NULL if not found.  If
+   sorted is set, dictionaries with string keys are expected to be
+   sorted by keys (in strcmp() order) and are searched by bisection. */
+static GVariant *
+variant_find (lua_State *L, GVariant *variant, int narg, gboolean sorted)
+{
+  const gchar *format = g_variant_get_type_string (variant);
+  GVariant *entry, *found = NULL;
+  gsize low = 0, high = g_variant_n_children (variant), i;
+
+  if (strchr ("sog", format[2]) != NULL && lua_type (L, narg) == LUA_TSTRING)
+    {
+      /* Compare string keys directly, without converting them. */
+      const gchar *key = lua_tostring (L, narg);
+      while (found == NULL && low < high)
+	{
+	  GVariant *child;
+	  int cmp;
+	  i = sorted ? low + (high - low) / 2 : low;
+	  entry = g_variant_get_child_value (variant, i);
+	  child = g_variant_get_child_value (entry, 0);
+	  cmp = strcmp (key, g_variant_get_string (child, NULL));
+	  g_variant_unref (child);
+	  if (cmp == 0)
+	    found = g_variant_get_child_value (entry, 1);
+	  else if (sorted && cmp < 0)
+	    high = i;
+	  else
+	    low = i + 1;
+	  g_variant_unref (entry);
+	}
+    }
+  else
+    /* Walk key-by-key, comparing converted keys. */
+    for (i = 0; found == NULL && i < high; i++)
+      {
+	entry = g_variant_get_child_value (variant, i);
+	variant_2lua_child (L, g_variant_get_child_value (entry, 0), 0);
+	if (lua_rawequal (L, -1, narg))
+	  found = g_variant_get_child_value (entry, 1);
+	lua_pop (L, 1);
+	g_variant_unref (entry);
+      }
+
+  return found;
+}
+
+/* Looks up value of given key in the dictionary and converts it the
+   same way as variant_get does.  Lua-side prototype:
+   value = core.marshal.variant_lookup(variant, key, dict) */
+static int
+marshal_variant_lookup (lua_State *L)
+{
+  GVariant *variant = variant_check (L, 1), *found = NULL;
+  const gchar *format = g_variant_get_type_string (variant);
+  luaL_checktype (L, 3, LUA_TFUNCTION);
+  luaL_argcheck (L, format[0] == 'a' && format[1] == '{', 1,
+		 "dictionary expected");
+
+  if (format[2] != 's')
+    found = variant_find (L, variant, 2, FALSE);
+  else if (lua_isstring (L, 2))
+    /* Use g_variant_lookup_value for string keys, which also unboxes
+       variant values. */
+    found = g_variant_lookup_value (variant, lua_tostring (L, 2), NULL);
+
+  if (found == NULL)
+    return 0;
+
+  variant_2lua_child (L, found, 3);
+  return 1;
+}
+
+/* Navigates from the variant through the path of child indices and
+   dictionary keys, unboxing 'v' variants on the way, and unpacks
+   only the final value the same way as variant_unpack does.  Returns
+   nothing if the path does not exist.  If sorted is set, dictionaries
+   with string keys are searched by bisection.  Lua-side prototype:
+   value = core.marshal.variant_at(variant, sorted, ...) */
+static int
+marshal_variant_at (lua_State *L)
+{
+  GVariant **current, *child;
+  gboolean sorted = lua_toboolean (L, 2);
+  int narg, top = lua_gettop (L);
+
+  /* Keep reference to the current node in the guard, so that it is
+     released also when an error is thrown. */
+  current = (GVariant **) lgi_guard_create (L,
+					    (GDestroyNotify) g_variant_unref);
+  *current = g_variant_ref (variant_check (L, 1));
+  for (narg = 3;; narg++)
+    {
+      const gchar *format;
+      while (g_variant_is_of_type (*current, G_VARIANT_TYPE_VARIANT))
+	{
+	  child = g_variant_get_variant (*current);
+	  g_variant_unref (*current);
+	  *current = child;
+	}
+      if (narg > top)
+	break;
+
+      /* Descend into dictionary value or indexed child. */
+      format = g_variant_get_type_string (*current);
+      if (format[0] == 'a' && format[1] == '{')
+	child = variant_find (L, *current, narg, sorted);
+      else if (strchr ("a({m", format[0]) != NULL)
+	{
+	  lua_Integer index = luaL_checkinteger (L, narg);
+	  child = (index >= 1
+		   && (gsize) index <= g_variant_n_children (*current))
+	    ? g_variant_get_child_value (*current, index - 1) : NULL;
+	}
+      else
+	child = NULL;
+      if (child == NULL)
+	return 0;
+
+      g_variant_unref (*current);
+      *current = child;
+    }
+
+  variant_2lua (L, *current, 0, 0);
+  g_variant_unref (*current);
+  *current = NULL;
+  return 1;
+}
+
+/* Creates floating tuple variant of given type from values on the
+   stack starting at narg, which are expected to be the topmost ones.
+   Missing values are treated as nil, extra values are dropped. */
+static GVariant *
+variant_new_tuple (lua_State *L, const GVariantType *type, int narg)
+{
+  const GVariantType *member;
+  GVariantBuilder **builder;
+  GVariant *variant;
+  int n_items = g_variant_type_n_items (type);
+
+  luaL_checkstack (L, n_items + 4, "");
+  lua_settop (L, narg + n_items - 1);
+  builder = (GVariantBuilder **)
+    lgi_guard_create (L, (GDestroyNotify) g_variant_builder_unref);
+  *builder = g_variant_builder_new (type);
+  for (member = g_variant_type_first (type); member != NULL;
+       member = g_variant_type_next (member), narg++)
+    variant_add (L, *builder, member, narg);
+  variant = g_variant_builder_end (*builder);
+  g_variant_builder_unref (*builder);
+  *builder = NULL;
+  lua_pop (L, 1);
+  return variant;
+}
+
+/* Encoder closure of variant_codec, upvalue is guard with the tuple
+   type. */
+static int
+variant_encode (lua_State *L)
+{
+  const GVariantType *type =
+    *(GVariantType **) lua_touserdata (L, lua_upvalueindex (1));
+  GVariant *variant = variant_new_tuple (L, type, 1);
+  lgi_type_get_repotype (L, G_TYPE_VARIANT, NULL);
+  lgi_record_2lua (L, variant, FALSE, 0);
+  return 1;
+}
+
+/* Decoder closure of variant_codec, upvalue is guard with the tuple
+   type. */
+static int
+variant_decode (lua_State *L)
+{
+  const GVariantType *type =
+    *(GVariantType **) lua_touserdata (L, lua_upvalueindex (1));
+  GVariant *variant = variant_check (L, 1);
+  gsize length, i;
+
+  if (!g_variant_is_of_type (variant, type))
+    {
+      lua_pushlstring (L, g_variant_type_peek_string (type),
+		       g_variant_type_get_string_length (type));
+      return luaL_error (L, "GLib.Variant: `%s' expected, got `%s'",
+			 lua_tostring (L, -1),
+			 g_variant_get_type_string (variant));
+    }
+
+  length = g_variant_n_children (variant);
+  luaL_checkstack (L, length, "");
+  for (i = 0; i < length; i++)
+    variant_2lua_child (L, g_variant_get_child_value (variant, i), 0);
+  return length;
+}
+
+/* Pushes guard with tuple type of the signature, i.e. concatenated
+   types of a list of values, and returns the type. */
+static const GVariantType *
+variant_tuple_type (lua_State *L, const gchar *signature)
+{
+  gchar *format = g_strconcat ("(", signature, ")", NULL);
+  const gchar *end;
+  gboolean valid = g_variant_type_string_scan (format, NULL, &end)
+    && *end == '\0' && strpbrk (format, "*?r") == NULL;
+  GVariantType **type;
+
+  if (!valid)
+    {
+      g_free (format);
+      luaL_error (L, "bad signature `%s'", signature);
+    }
+
+  type = (GVariantType **) lgi_guard_create (L, (GDestroyNotify)
+					     g_variant_type_free);
+  *type = g_variant_type_new (format);
+  g_free (format);
+  return *type;
+}
+
+/* Compiles signature into encoder, which converts its arguments into
+   tuple GLib.Variant of these types, and decoder, which unpacks such
+   tuple into multiple values the same way as variant_unpack does.
+   Lua-side prototype:
+   encode, decode = core.marshal.variant_codec(signature) */
+static int
+marshal_variant_codec (lua_State *L)
+{
+  /* Both closures share the guard holding the parsed type. */
+  variant_tuple_type (L, luaL_checkstring (L, 1));
+  lua_pushvalue (L, -1);
+  lua_pushcclosure (L, variant_encode, 1);
+  lua_insert (L, -2);
+  lua_pushcclosure (L, variant_decode, 1);
+  return 2;
+}
+
+/* GDBusInterfaceVTable.  lgi does not link gio, so the layout is
+   replicated here; it is part of the stable gio ABI. */
+typedef struct _DBusInterfaceVTable
+{
+  gpointer method_call;
+  gpointer get_property;
+  gpointer set_property;
+  gpointer padding[8];
+} DBusInterfaceVTable;
+
+/* Data of object exported on D-Bus by dbus_export.  It serves both as
+   the vtable and user_data of the registered object. */
+typedef struct _DBusExport
+{
+  /* Vtable, must be the first member. */
+  DBusInterfaceVTable vtable;
+
+  /* Lua thread in which methods are invoked and its reference. */
+  lua_State *L;
+  int thread_ref;
+
+  /* State lock, to be passed to lgi_state_enter() when a method is
+     invoked. */
+  gpointer state_lock;
+
+  /* Reference to dispatch table, mapping method names to pairs of
+     Lua method and guard with the tuple type of its results, and to
+     the table with methods, passed to them as self. */
+  int dispatch_ref;
+  int self_ref;
+
+  /* g_dbus_method_invocation_return_value() and
+     g_dbus_method_invocation_return_dbus_error(), resolved from the
+     typelib. */
+  void (*return_value) (gpointer invocation, GVariant *parameters);
+  void (*return_error) (gpointer invocation, const gchar *error_name,
+			const gchar *error_message);
+} DBusExport;
+
+/* Arguments and results of single method call, passed to the
+   protected dbus_export_call(). */
+typedef struct _DBusExportCall
+{
+  DBusExport *export;
+  const gchar *method_name;
+  GVariant *parameters;
+  const gchar *error_name;
+  GVariant *reply;
+} DBusExportCall;
+
+/* Dispatches the method call, unpacking parameters directly to the
+   arguments of Lua method and creating reply from its results. */
+static int
+dbus_export_call (lua_State *L)
+{
+  DBusExportCall *call = lua_touserdata (L, 1);
+  const GVariantType *type;
+  gsize length, i;
+  int base;
+
+  lua_rawgeti (L, LUA_REGISTRYINDEX, call->export->dispatch_ref);
+  lua_pushstring (L, call->method_name);
+  lua_rawget (L, -2);
+  if (lua_isnil (L, -1))
+    {
+      call->error_name = "org.freedesktop.DBus.Error.UnknownMethod";
+      return luaL_error (L, "unknown method `%s'", call->method_name);
+    }
+  lua_rawgeti (L, -1, 2);
+  type = *(GVariantType **) lua_touserdata (L, -1);
+
+  /* Invoke the method, the tuple type stays anchored on the stack. */
+  base = lua_gettop (L);
+  length = g_variant_n_children (call->parameters);
+  luaL_checkstack (L, length + 2, "");
+  lua_rawgeti (L, -2, 1);
+  lua_rawgeti (L, LUA_REGISTRYINDEX, call->export->self_ref);
+  for (i = 0; i < length; i++)
+    variant_2lua_child (L, g_variant_get_child_value (call->parameters, i),
+			0);
+  lua_call (L, length + 1, LUA_MULTRET);
+  call->reply = variant_new_tuple (L, type, base + 1);
+  return 0;
+}
+
+/* method_call entry of the vtable. */
+static void
+dbus_export_method_call (gpointer connection, const gchar *sender,
+			 const gchar *object_path,
+			 const gchar *interface_name,
+			 const gchar *method_name, GVariant *parameters,
+			 gpointer invocation, gpointer user_data)
+{
+  DBusExport *export = user_data;
+  DBusExportCall call;
+  lua_State *L;
+  int stacktop;
+  (void) connection;
+  (void) sender;
+  (void) object_path;
+  (void) interface_name;
+
+  /* Get access to proper Lua context. */
+  lgi_state_enter (export->state_lock);
+  lua_rawgeti (export->L, LUA_REGISTRYINDEX, export->thread_ref);
+  L = lua_tothread (export->L, -1);
+  if (lua_status (L) != 0)
+    {
+      /* Thread is suspended and we cannot resume it, so create new
+	 thread and switch the export to its context. */
+      lua_State *newL = lua_newthread (L);
+      lua_rawseti (L, LUA_REGISTRYINDEX, export->thread_ref);
+      L = newL;
+    }
+  lua_pop (export->L, 1);
+  export->L = L;
+
+  /* Errors raised by the method are returned to the caller. */
+  stacktop = lua_gettop (L);
+  call.export = export;
+  call.method_name = method_name;
+  call.parameters = parameters;
+  call.error_name = "org.freedesktop.DBus.Error.Failed";
+  call.reply = NULL;
+  lua_pushcfunction (L, dbus_export_call);
+  lua_pushlightuserdata (L, &call);
+  if (lua_pcall (L, 1, 0, 0) == 0)
+    export->return_value (invocation, call.reply);
+  else
+    export->return_error (invocation, call.error_name,
+			  lua_isstring (L, -1) ? lua_tostring (L, -1)
+			  : "error raised by method");
+
+  lua_settop (L, stacktop);
+  lgi_state_leave (export->state_lock);
+}
+
+/* user_data_free_func of the registered object. */
+static void
+dbus_export_free (gpointer user_data)
+{
+  DBusExport *export = user_data;
+  lgi_state_enter (export->state_lock);
+  luaL_unref (export->L, LUA_REGISTRYINDEX, export->dispatch_ref);
+  luaL_unref (export->L, LUA_REGISTRYINDEX, export->self_ref);
+  luaL_unref (export->L, LUA_REGISTRYINDEX, export->thread_ref);
+  lgi_state_leave (export->state_lock);
+  g_free (export);
+}
+
+/* Creates data for g_dbus_connection_register_object().  Methods of
+   the object are looked up in methods table by names of signatures
+   table, which contains signatures of their results.  Returned export
+   serves as both vtable and user_data, free is the address of
+   user_data_free_func.  Lua-side prototype:
+   export, free = core.marshal.dbus_export(methods, signatures,
+					   return_value, return_error) */
+static int
+marshal_dbus_export (lua_State *L)
+{
+  DBusExport *export;
+  luaL_checktype (L, 1, LUA_TTABLE);
+  luaL_checktype (L, 2, LUA_TTABLE);
+  luaL_checktype (L, 3, LUA_TLIGHTUSERDATA);
+  luaL_checktype (L, 4, LUA_TLIGHTUSERDATA);
+  lua_settop (L, 4);
+
+  /* Compile dispatch table, methods missing in the methods table are
+     left undispatched. */
+  lua_newtable (L);
+  lua_pushnil (L);
+  while (lua_next (L, 2) != 0)
+    {
+      lua_pushvalue (L, -2);
+      lua_gettable (L, 1);
+      if (!lua_isnil (L, -1))
+	{
+	  lua_createtable (L, 2, 0);
+	  lua_insert (L, -2);
+	  lua_rawseti (L, -2, 1);
+	  variant_tuple_type (L, luaL_checkstring (L, -2));
+	  lua_rawseti (L, -2, 2);
+	  lua_pushvalue (L, -3);
+	  lua_insert (L, -2);
+	  lua_rawset (L, 5);
+	}
+      else
+	lua_pop (L, 1);
+      lua_pop (L, 1);
+    }
+
+  export = g_new0 (DBusExport, 1);
+  export->vtable.method_call = dbus_export_method_call;
+  export->return_value = lua_touserdata (L, 3);
+  export->return_error = lua_touserdata (L, 4);
+  export->state_lock = lgi_state_get_lock (L);
+  export->dispatch_ref = luaL_ref (L, LUA_REGISTRYINDEX);
+  lua_pushvalue (L, 1);
+  export->self_ref = luaL_ref (L, LUA_REGISTRYINDEX);
+  lua_pushthread (L);
+  export->thread_ref = luaL_ref (L, LUA_REGISTRYINDEX);
+  export->L = L;
+
+  lua_pushlightuserdata (L, export);
+  lua_pushlightuserdata (L, dbus_export_free);
+  return 2;
+}
+
+/* Enables or disables global adoption of owned byte arrays by
+   'bytes' buffers, returns previous setting.  Lua-side prototype:
+   enabled = core.marshal.buffers([enable]) */
+static int
+marshal_buffers (lua_State *L)
+{
+  int *flags = lgi_marshal_buffers (L);
+  lua_pushboolean (L, (*flags & LGI_BUFFERS_GLOBAL) != 0);
+  if (!lua_isnone (L, 1))
+    {
+      if (lua_toboolean (L, 1))
+	*flags |= LGI_BUFFERS_GLOBAL;
+      else
+	*flags &= ~LGI_BUFFERS_GLOBAL;
+    }
+  return 1;
+}
+
+static const struct luaL_Reg marshal_api_reg[] = {
+  { "container", marshal_container },
+  { "fundamental", marshal_fundamental },
+  { "argument", marshal_argument },
+  { "callback", marshal_callback },
+  { "vfunc", marshal_vfunc },
+  { "closure_set_marshal", marshal_closure_set_marshal },
+  { "closure_set_target", marshal_closure_set_target },
+  { "closure_set_owner", marshal_closure_set_owner },
+  { "property", marshal_property },
+  { "value", marshal_value },
+  { "closure_invoke", marshal_closure_invoke },
+  { "typeinfo", marshal_typeinfo },
+  { "access_attribute", marshal_access_attribute },
+  { "access_default", marshal_access_default },
+  { "access_epoch", marshal_access_epoch },
+  { "buffers", marshal_buffers },
+  { "variant_new", marshal_variant_new },
+  { "variant_get", marshal_variant_get },
+  { "variant_unpack", marshal_variant_unpack },
+  { "variant_child", marshal_variant_child },
+  { "variant_entry", marshal_variant_entry },
+  { "variant_lookup", marshal_variant_lookup },
+  { "variant_at", marshal_variant_at },
+  { "variant_codec", marshal_variant_codec },
+  { "dbus_export", marshal_dbus_export },
+  { NULL, NULL }
+};
+
+void
+lgi_marshal_init (lua_State *L)
+{
+  /* Create cache of category access handler names. */
+  lua_pushlightuserdata (L, &access_handlers);
+  lua_newtable (L);
+  lua_rawset (L, LUA_REGISTRYINDEX);
+
+  /* Create cache of resolved access handlers of typetables. */
+  lgi_cache_create (L, &access_cache, "k");
+
+  /* Create flags of byte arrays adoption. */
+  lua_pushlightuserdata (L, &buffers);
+  *(int *) lua_newuserdata (L, sizeof (int)) = 0;
+  lua_rawset (L, LUA_REGISTRYINDEX);
+
   /* Create 'marshal' API table in main core API table. */
   lua_newtable (L);
   luaL_register (L, NULL, marshal_api_reg);
@@ -18,35 +18,42 @@ static int cache;
 /* lightuserdata key to registry for metatable of objects. */
 static int object_mt;
 
-/* lightuserdata key to registry, containing 'env' table, which maps
-   lightuserdata(obj-addr) -> obj-env-table. */
+/* lightuserdata key to registry, containing 'anchor' table, which
+   maps lightuserdata(obj-addr) -> proxy for objects owned through
+   toggle reference which are referenced also from outside of Lua. */
+static int anchor;
+
+/* lightuserdata key to registry, containing ObjectToggle userdata
+   used as data of toggle references of the state. */
+static int toggle;
+
+/* Objects which store any Lua-side state (env table, targets of
+   their signal handlers) have proxy env replaced by 'holder' table.
+   Holder contains the typetable at lightuserdata(&holder) key, env
+   table at lightuserdata(&env) key and other slots keyed by arbitrary
+   lightuserdata.  Proxy owns such objects by toggle reference (marked
+   by true at lightuserdata(&toggle) key), so that the state is kept
+   alive by the proxy only. */
+static int holder;
 static int env;
 
-/* Keys in 'env' table containing quark used as object's qdata for env
-   and thread which is used from qdata destroy callback. */
-enum {
-  OBJECT_QDATA_ENV = 1,
-  OBJECT_QDATA_THREAD
-};
-
-/* Structure stored in GObject's qdata at OBJECT_QDATA_ENV. */
-typedef struct _ObjectData
+/* Structure passed as data of toggle references. */
+typedef struct _ObjectToggle
 {
-  gpointer object;
-  gpointer state_lock;
   lua_State *L;
-} ObjectData;
-
-/* lightuserdata key to registry, containing metatable for object env
-   guard. */
-static int env_mt;
+  gpointer state_lock;
+} ObjectToggle;
 
-/* Structure containing object_env_guard userdata. */
-typedef struct _ObjectEnvGuard
+/* Userdata of the object proxy. */
+typedef struct _ObjectProxy
 {
+  /* Address of the object, must be the first member. */
   gpointer object;
-  GQuark id;
-} ObjectEnvGuard;
+
+  /* Estimated size of native memory owned by the object, accounted
+     by lgi_memory_add(). */
+  gsize memsize;
+} ObjectProxy;
 
 /* Checks that given narg is object type and returns pointer to type
    instance representing it. */
@@ -126,6 +133,21 @@ object_get (lua_State *L, int narg)
   return obj;
 }
 
+/* Pushes typetable of the object proxy at narg. */
+static void
+object_push_type (lua_State *L, int narg)
+{
+  lua_getfenv (L, narg);
+  if (!lua_istable (L, -1))
+    return;
+  lua_pushlightuserdata (L, &holder);
+  lua_rawget (L, -2);
+  if (lua_isnil (L, -1))
+    lua_pop (L, 1);
+  else
+    lua_replace (L, -2);
+}
+
 /* This is workaround method for broken
    g_object_info_get_*_function_pointer() in GI 1.32.0. (see
    https://bugzilla.gnome.org/show_bug.cgi?id=673282) */
@@ -262,14 +284,253 @@ object_unref (lua_State *L, gpointer obj)
 #endif
 }
 
+static ObjectToggle *
+object_toggle_data (lua_State *L)
+{
+  ObjectToggle *data;
+  lua_pushlightuserdata (L, &toggle);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  data = lua_touserdata (L, -1);
+  lua_pop (L, 1);
+  return data;
+}
+
+/* Toggle reference notification; anchors the proxy while the object
+   is referenced also from outside of Lua, so that its Lua-side state
+   survives, and releases the anchor when the proxy holds the last
+   reference, so that the proxy and its state is normally collected. */
+static void
+object_toggle_notify (gpointer user_data, GObject *obj, gboolean is_last_ref)
+{
+  ObjectToggle *data = user_data;
+  lua_State *L = data->L;
+  lgi_state_enter (data->state_lock);
+  luaL_checkstack (L, 4, NULL);
+  lua_pushlightuserdata (L, &anchor);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushlightuserdata (L, obj);
+  if (is_last_ref)
+    lua_pushnil (L);
+  else
+    {
+      /* Proxy might be already gone if it is just being collected;
+	 in this case, nil is stored and the object outlives it. */
+      lua_pushlightuserdata (L, &cache);
+      lua_rawget (L, LUA_REGISTRYINDEX);
+      lua_pushlightuserdata (L, obj);
+      lua_rawget (L, -2);
+      lua_replace (L, -2);
+    }
+  lua_rawset (L, -3);
+  lua_pop (L, 1);
+  lgi_state_leave (data->state_lock);
+}
+
+/* Pushes holder table of the object proxy at narg and returns TRUE.
+   If the proxy does not have holder yet and create is requested, the
+   holder is created and ownership of the object is switched to the
+   toggle reference.  Otherwise nothing is pushed and FALSE is
+   returned. */
+static gboolean
+object_get_holder (lua_State *L, int narg, gpointer obj, gboolean create)
+{
+  lgi_makeabs (L, narg);
+  luaL_checkstack (L, 4, "");
+  lua_getfenv (L, narg);
+  lua_pushlightuserdata (L, &holder);
+  lua_rawget (L, -2);
+  if (!lua_isnil (L, -1))
+    {
+      lua_pop (L, 1);
+      return TRUE;
+    }
+  if (!create || !G_IS_OBJECT (obj))
+    {
+      /* Only GObject instances support toggle references. */
+      lua_pop (L, 2);
+      return FALSE;
+    }
+
+  /* Create new holder referencing object's typetable and set it as
+     env of the proxy. */
+  lua_pop (L, 1);
+  lua_newtable (L);
+  lua_pushlightuserdata (L, &holder);
+  lua_pushvalue (L, -3);
+  lua_rawset (L, -3);
+  lua_replace (L, -2);
+  lua_pushvalue (L, -1);
+  lua_setfenv (L, narg);
+
+  /* Replace reference held by the proxy with toggle reference.  The
+     proxy is anchored first; if the proxy holds the last reference,
+     unref below invokes toggle notification which releases the
+     anchor. */
+  lua_pushlightuserdata (L, &anchor);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushlightuserdata (L, obj);
+  lua_pushvalue (L, narg);
+  lua_rawset (L, -3);
+  lua_pop (L, 1);
+  lua_pushlightuserdata (L, &toggle);
+  lua_pushboolean (L, 1);
+  lua_rawset (L, -3);
+  g_object_add_toggle_ref (obj, object_toggle_notify, object_toggle_data (L));
+  g_object_unref (obj);
+  return TRUE;
+}
+
+/* Pushes the proxy of given object from the cache, or nil. */
+static void
+object_push_cached (lua_State *L, gpointer obj)
+{
+  luaL_checkstack (L, 3, "");
+  lua_pushlightuserdata (L, &cache);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushlightuserdata (L, obj);
+  lua_rawget (L, -2);
+  lua_replace (L, -2);
+}
+
+gboolean
+lgi_object_set_slot (lua_State *L, gpointer obj, gpointer key)
+{
+  /* Find the proxy and its holder, which is created only when
+     non-nil value is stored. */
+  object_push_cached (L, obj);
+  if (lua_isnil (L, -1)
+      || !object_get_holder (L, -1, obj, !lua_isnil (L, -2)))
+    {
+      lua_pop (L, 2);
+      return FALSE;
+    }
+
+  lua_pushlightuserdata (L, key);
+  lua_pushvalue (L, -4);
+  lua_rawset (L, -3);
+  lua_pop (L, 3);
+  return TRUE;
+}
+
+/* Pushes holder of the object whose proxy is just being collected,
+   or nil. */
+static void
+object_push_dying_holder (lua_State *L, gpointer obj)
+{
+  luaL_checkstack (L, 3, "");
+  lua_pushlightuserdata (L, &anchor);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushlightuserdata (L, obj);
+  lua_rawget (L, -2);
+  lua_replace (L, -2);
+  if (!lua_istable (L, -1))
+    {
+      lua_pop (L, 1);
+      lua_pushnil (L);
+    }
+}
+
+/* If the object is being disposed after its proxy was collected, sets
+   copy of the holder of the collected proxy as env of the new proxy
+   on the top of the stack.  New proxy owns the object by normal
+   reference, so the copy does not contain toggle mark. */
+static void
+object_adopt_holder (lua_State *L, gpointer obj)
+{
+  object_push_dying_holder (L, obj);
+  if (lua_isnil (L, -1))
+    {
+      lua_pop (L, 1);
+      return;
+    }
+
+  lua_newtable (L);
+  lua_pushnil (L);
+  while (lua_next (L, -3) != 0)
+    {
+      if (lua_touserdata (L, -2) == &toggle)
+	lua_pop (L, 1);
+      else
+	{
+	  lua_pushvalue (L, -2);
+	  lua_insert (L, -2);
+	  lua_rawset (L, -4);
+	}
+    }
+  lua_setfenv (L, -3);
+  lua_pop (L, 1);
+}
+
+void
+lgi_object_get_slot (lua_State *L, gpointer obj, gpointer key)
+{
+  object_push_cached (L, obj);
+  if (lua_isnil (L, -1))
+    {
+      /* Use the state of the collected proxy, if the object is just
+	 being disposed. */
+      lua_pop (L, 1);
+      object_push_dying_holder (L, obj);
+      if (!lua_isnil (L, -1))
+	{
+	  lua_pushlightuserdata (L, key);
+	  lua_rawget (L, -2);
+	  lua_replace (L, -2);
+	}
+      return;
+    }
+
+  if (object_get_holder (L, -1, obj, FALSE))
+    {
+      lua_pushlightuserdata (L, key);
+      lua_rawget (L, -2);
+      lua_replace (L, -3);
+      lua_pop (L, 1);
+    }
+  else
+    {
+      lua_pop (L, 1);
+      lua_pushnil (L);
+    }
+}
+
 static int
 object_gc (lua_State *L)
 {
-  object_unref (L, object_get (L, 1));
+  gpointer obj = object_get (L, 1);
+  ObjectProxy *proxy = lua_touserdata (L, 1);
 
-  /* Unset the metatable / make the object unusable */
-  lua_pushnil (L);
-  lua_setmetatable (L, 1);
+  lgi_memory_remove (L, proxy->memsize);
+
+  if (object_get_holder (L, 1, obj, FALSE))
+    {
+      lua_pushlightuserdata (L, &toggle);
+      lua_rawget (L, -2);
+      if (lua_toboolean (L, -1))
+	{
+	  /* Object is owned by the toggle reference.  Keep the holder
+	     available in the 'anchor' table while the reference is
+	     removed, so that the state of the object is accessible to
+	     Lua code invoked during its disposal. */
+	  lua_pushlightuserdata (L, &anchor);
+	  lua_rawget (L, LUA_REGISTRYINDEX);
+	  lua_pushlightuserdata (L, obj);
+	  lua_pushvalue (L, -4);
+	  lua_rawset (L, -3);
+	  g_object_remove_toggle_ref (obj, object_toggle_notify,
+				      object_toggle_data (L));
+	  lua_pushlightuserdata (L, obj);
+	  lua_pushnil (L);
+	  lua_rawset (L, -3);
+	}
+      else
+	object_unref (L, obj);
+    }
+  else
+    object_unref (L, obj);
+
+  /* Make the object unusable, closing it again is harmless. */
+  lgi_udata_release (L, 1);
   return 0;
 }
 
@@ -278,7 +539,7 @@ object_tostring (lua_State *L)
 {
   gpointer obj = object_get (L, 1);
   GType gtype = G_TYPE_FROM_INSTANCE (obj);
-  lua_getfenv (L, 1);
+  object_push_type (L, 1);
   if (lua_isnil (L, -1))
     lua_pushliteral (L, "<??\?>");
   else
@@ -323,6 +584,8 @@ lgi_object_2c (lua_State *L, int narg, GType gtype, gboolean optional,
 int
 lgi_object_2lua (lua_State *L, gpointer obj, gboolean own, gboolean no_sink)
 {
+  ObjectProxy *proxy;
+
   /* NULL pointer results in nil. */
   if (!obj)
     {
@@ -350,13 +613,15 @@ lgi_object_2lua (lua_State *L, gpointer obj, gboolean own, gboolean no_sink)
     }
 
   /* Create new userdata object. */
-  *(gpointer *) lua_newuserdata (L, sizeof (obj)) = obj;
+  proxy = lua_newuserdata (L, sizeof (ObjectProxy));
+  proxy->object = obj;
+  proxy->memsize = 0;
   lua_pushlightuserdata (L, &object_mt);
   lua_rawget (L, LUA_REGISTRYINDEX);
   lua_setmetatable (L, -2);
   object_type (L, G_TYPE_FROM_INSTANCE (obj));
   lua_setfenv (L, -2);
-
+  object_adopt_holder (L, obj);
 
   /* Store newly created userdata proxy into cache. */
   lua_pushlightuserdata (L, obj);
@@ -372,6 +637,12 @@ lgi_object_2lua (lua_State *L, gpointer obj, gboolean own, gboolean no_sink)
   if (!own)
     object_refsink (L, obj, no_sink);
 
+  /* Account native memory owned by the object. */
+  object_push_type (L, -1);
+  if (lua_istable (L, -1))
+    proxy->memsize = lgi_memory_estimate (L, -1, -2, obj, FALSE);
+  lua_pop (L, 1);
+  lgi_memory_add (L, proxy->memsize);
   return 1;
 }
 
@@ -385,13 +656,50 @@ object_access (lua_State *L)
      result = type:_access(objectinstance, name)
      type:_access(objectinstance, name, val) */
   object_get (L, 1);
-  lua_getfenv (L, 1);
+  object_push_type (L, 1);
   return lgi_marshal_access (L, getmode, 1, 2, 3);
 }
 
+/* Releases the object immediately, the proxy is unusable afterwards.
+   Lua-side state of the object is dropped together with the proxy,
+   even if the object itself stays alive.  Returns true if the
+   argument was object proxy.  Lua-side prototype:
+   res = object.release(objectinstance) */
+static int
+object_release (lua_State *L)
+{
+  gpointer obj = object_check (L, 1);
+  int i;
+  if (obj == NULL)
+    return 0;
+
+  /* Remove the proxy from the cache and anchor tables. */
+  lua_settop (L, 1);
+  for (i = 0; i < 2; i++)
+    {
+      lua_pushlightuserdata (L, i == 0 ? &cache : &anchor);
+      lua_rawget (L, LUA_REGISTRYINDEX);
+      lua_pushlightuserdata (L, obj);
+      lua_rawget (L, -2);
+      if (lua_rawequal (L, -1, 1))
+	{
+	  lua_pushlightuserdata (L, obj);
+	  lua_pushnil (L);
+	  lua_rawset (L, -4);
+	}
+      lua_settop (L, 1);
+    }
+
+  /* Perform the same cleanup as the collector does. */
+  object_gc (L);
+  lua_pushboolean (L, 1);
+  return 1;
+}
+
 /* Registration table. */
 static const luaL_Reg object_mt_reg[] = {
   { "__gc", object_gc },
+  { "__close", object_release },
   { "__tostring", object_tostring },
   { "__index", object_access },
   { "__newindex", object_access },
@@ -415,7 +723,7 @@ object_query (lua_State *L)
       if (mode == 0)
 	lua_pushlightuserdata (L, object);
       else
-	lua_getfenv (L, 1);
+	object_push_type (L, 1);
       return 1;
     }
   return 0;
@@ -434,43 +742,19 @@ object_field (lua_State *L)
   gpointer object = object_get (L, 1);
 
   /* Call field marshalling worker. */
-  lua_getfenv (L, 1);
+  object_push_type (L, 1);
   return lgi_marshal_field (L, object, getmode, 1, 2, 3);
 }
 
-static void
-object_data_destroy (gpointer user_data)
-{
-  ObjectData *data = user_data;
-  lua_State *L = data->L;
-  lgi_state_enter (data->state_lock);
-  luaL_checkstack (L, 4, NULL);
-
-  /* Release 'obj' entry from 'env' table. */
-  lua_pushlightuserdata (L, &env);
-  lua_rawget (L, LUA_REGISTRYINDEX);
-
-  /* Deactivate env_destroy, to avoid double destruction. */
-  lua_pushlightuserdata (L, data->object);
-  lua_rawget (L, -2);
-  if (!lua_isnil (L, -1))
-    *(gpointer **) lua_touserdata (L, -1) = NULL;
-  lua_pushlightuserdata (L, data->object);
-  lua_pushnil (L);
-  lua_rawset (L, -4);
-  lua_pop (L, 2);
-
-  /* Leave the context and destroy data structure. */
-  lgi_state_leave (data->state_lock);
-  g_free (data);
-}
-
+/* Implementation of class' _access_field, so that field access can be
+   dispatched without entering Lua.  Lua-side prototype:
+   res = object.access_field(typetable, objectinstance, gi.fieldinfo)
+   object.access_field(typetable, objectinstance, gi.fieldinfo, newvalue) */
 static int
-object_env_guard_gc (lua_State *L)
+object_access_field (lua_State *L)
 {
-  ObjectEnvGuard *guard = lua_touserdata (L, -1);
-  g_free (g_object_steal_qdata (G_OBJECT (guard->object), guard->id));
-  return 0;
+  lua_remove (L, 1);
+  return object_field (L);
 }
 
 /* Object environment table accessor.  Lua-side prototype:
@@ -478,56 +762,21 @@ object_env_guard_gc (lua_State *L)
 static int
 object_env (lua_State *L)
 {
-  ObjectData *data;
   gpointer obj = object_get (L, 1);
-  if (!G_IS_OBJECT (obj))
+  if (!object_get_holder (L, 1, obj, TRUE))
     /* Only GObject instances can have environment. */
     return 0;
 
-  /* Lookup 'env' table. */
+  /* Lookup env table in the holder, create it if not present yet. */
   lua_pushlightuserdata (L, &env);
-  lua_rawget (L, LUA_REGISTRYINDEX);
-  lua_pushlightuserdata (L, obj);
   lua_rawget (L, -2);
-  if (!lua_isnil (L, -1))
-    /* Object's env table for the object is attached to the
-       controlling userdata in the 'env' table. */
-    lua_getfenv (L, -1);
-  else
+  if (lua_isnil (L, -1))
     {
-      ObjectEnvGuard *guard;
-
-      /* Create new table which will serve as an object env table. */
-      lua_newtable (L);
-
-      /* Create userdata guard, which disconnects env when the state
-	 dies.  Attach the actual env table as env table to the guard
-	 udata. */
-      guard = lua_newuserdata (L, sizeof (ObjectEnvGuard));
-      guard->object = obj;
-      lua_rawgeti (L, -4, OBJECT_QDATA_ENV);
-      guard->id = lua_tointeger (L, -1);
       lua_pop (L, 1);
+      lua_newtable (L);
+      lua_pushlightuserdata (L, &env);
       lua_pushvalue (L, -2);
-      lua_setfenv (L, -2);
-
-      /* Store it to the 'env' table. */
-      lua_pushlightuserdata (L, obj);
-      lua_pushvalue (L, -2);
-      lua_rawset (L, -6);
-
-      /* Create and fill new ObjectData structure, to attach it to
-	 object's qdata. */
-      data = g_new (ObjectData, 1);
-      data->object = obj;
-      lua_rawgeti (L, -4, OBJECT_QDATA_THREAD);
-      data->L = lua_tothread (L, -1);
-      data->state_lock = lgi_state_get_lock (data->L);
-
-      /* Attach ObjectData to the object. */
-      g_object_set_qdata_full (G_OBJECT (obj), guard->id,
-			       data, object_data_destroy);
-      lua_pop (L, 2);
+      lua_rawset (L, -4);
     }
 
   return 1;
@@ -578,11 +827,384 @@ object_new (lua_State *L)
     }
 }
 
+/* Key of the registry table caching pspecs of construction properties,
+   indexed by GType and then by property name.  Classes of the cached
+   types are kept referenced, so that the pspecs stay valid. */
+static int construct_cache;
+
+/* Construction properties of the object being created. */
+typedef struct _ObjectConstruct
+{
+  guint n_properties;
+  const char **names;
+  GValue *values;
+} ObjectConstruct;
+
+/* Releases ObjectConstruct together with all its values. */
+static void
+object_construct_free (ObjectConstruct *construct)
+{
+  guint i;
+  for (i = 0; i < construct->n_properties; i++)
+    if (G_IS_VALUE (&construct->values[i]))
+      g_value_unset (&construct->values[i]);
+  g_free (construct->names);
+  g_free (construct->values);
+  g_free (construct);
+}
+
+/* Pushes pspec cache of the class of given gtype, creates it if it
+   does not exist yet. */
+static void
+object_construct_cache (lua_State *L, GType gtype)
+{
+  lua_pushlightuserdata (L, &construct_cache);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushlightuserdata (L, GSIZE_TO_POINTER (gtype));
+  lua_rawget (L, -2);
+  if (lua_isnil (L, -1))
+    {
+      lua_pop (L, 1);
+      g_type_class_ref (gtype);
+      lua_newtable (L);
+      lua_pushlightuserdata (L, GSIZE_TO_POINTER (gtype));
+      lua_pushvalue (L, -2);
+      lua_rawset (L, -4);
+    }
+  lua_replace (L, -2);
+}
+
+/* Finds pspec of the construction property named by the string at
+   narg, using pspec cache of the class at index cache. */
+static GParamSpec *
+object_construct_find (lua_State *L, GType gtype, int cache, int narg)
+{
+  GParamSpec *pspec;
+  if (lua_type (L, narg) != LUA_TSTRING)
+    luaL_error (L, "%s: bad property name", g_type_name (gtype));
+
+  lua_pushvalue (L, narg);
+  lua_rawget (L, cache);
+  pspec = lua_touserdata (L, -1);
+  lua_pop (L, 1);
+  if (pspec == NULL)
+    {
+      pspec = g_object_class_find_property (g_type_class_peek (gtype),
+					    lua_tostring (L, narg));
+      if (pspec == NULL)
+	luaL_error (L, "%s: no property `%s'", g_type_name (gtype),
+		    lua_tostring (L, narg));
+      lua_pushvalue (L, narg);
+      lua_pushlightuserdata (L, pspec);
+      lua_rawset (L, cache);
+    }
+  return pspec;
+}
+
+/* Creates new object with construction properties.  Values which
+   cannot be marshalled natively are marshalled by marshallers from the
+   table into Value records.  Lua-side prototype:
+   res = object.construct(gtype, { name = value }, count, { name = marshaller })
+   Names of properties are expected in canonical form. */
+static int
+object_construct (lua_State *L)
+{
+  ObjectConstruct *construct;
+  GType gtype = lgi_type_get_gtype (L, 1);
+  lua_Integer count;
+  gpointer *guard;
+  GParamSpec *pspec;
+  GValue *value;
+  gpointer obj;
+  guint i = 0;
+
+  luaL_checktype (L, 2, LUA_TTABLE);
+  count = luaL_checkinteger (L, 3);
+  luaL_argcheck (L, count >= 0
+		 && (guint64) count <= G_MAXUINT / sizeof (GValue), 3,
+		 "bad number of properties");
+  lua_settop (L, 4);
+  object_construct_cache (L, gtype);
+
+  /* Prepare construction properties, owned by the guard until the
+     object is created.  Slot 7 keeps alive Value records of
+     properties which cannot be marshalled natively. */
+  guard = lgi_guard_create (L, (GDestroyNotify) object_construct_free);
+  construct = g_new0 (ObjectConstruct, 1);
+  *guard = construct;
+  construct->n_properties = count;
+  construct->names = g_new0 (const char *, count);
+  construct->values = g_new0 (GValue, count);
+  lua_pushnil (L);
+
+  lua_pushnil (L);
+  while (lua_next (L, 2) != 0)
+    {
+      if (i >= construct->n_properties)
+	return luaL_error (L, "too many construction properties");
+
+      /* Find pspec of the property. */
+      pspec = object_construct_find (L, gtype, 5, lua_gettop (L) - 1);
+      construct->names[i] = g_param_spec_get_name (pspec);
+
+      /* Marshal the value. */
+      g_value_init (&construct->values[i], G_PARAM_SPEC_VALUE_TYPE (pspec));
+      if (!lgi_marshal_value_2c (L, -1, &construct->values[i]))
+	{
+	  /* Marshal into Value record and keep it alive until the
+	     object is constructed. */
+	  if (lua_isnil (L, 7))
+	    {
+	      lua_newtable (L);
+	      lua_replace (L, 7);
+	    }
+	  lgi_type_get_repotype (L, G_TYPE_VALUE, NULL);
+	  value = lgi_record_new (L, 1, FALSE);
+	  lua_pushvalue (L, -1);
+	  lua_rawseti (L, 7, lua_objlen (L, 7) + 1);
+	  g_value_init (value, G_VALUE_TYPE (&construct->values[i]));
+	  lua_pushvalue (L, -3);
+	  lua_rawget (L, 4);
+	  lua_insert (L, -2);
+	  lua_pushnil (L);
+	  lua_pushvalue (L, -4);
+	  lua_call (L, 3, 0);
+	  g_value_unset (&construct->values[i]);
+	  g_value_init (&construct->values[i], G_VALUE_TYPE (value));
+	  g_value_copy (value, &construct->values[i]);
+	}
+      lua_pop (L, 1);
+      i++;
+    }
+
+#if GLIB_CHECK_VERSION(2, 54, 0)
+  obj = g_object_new_with_properties (gtype, i, construct->names,
+				      construct->values);
+#else
+  {
+    GParameter *params = g_new (GParameter, i);
+    guint j;
+    for (j = 0; j < i; j++)
+      {
+	params[j].name = construct->names[j];
+	params[j].value = construct->values[j];
+      }
+    obj = g_object_newv (gtype, i, params);
+    g_free (params);
+  }
+#endif
+
+  /* Release all values. */
+  object_construct_free (construct);
+  *guard = NULL;
+  return lgi_object_2lua (L, obj, TRUE, FALSE);
+}
+
+/* Properties of the object accessed in bulk. */
+typedef struct _ObjectProperties
+{
+  GObject *object;
+  guint n_properties;
+  const char **names;
+  GValue *values;
+} ObjectProperties;
+
+/* Releases ObjectProperties together with all their values. */
+static void
+object_properties_free (ObjectProperties *props)
+{
+  guint i;
+  for (i = 0; i < props->n_properties; i++)
+    if (G_IS_VALUE (&props->values[i]))
+      g_value_unset (&props->values[i]);
+  g_free (props->names);
+  g_free (props->values);
+  g_free (props);
+}
+
+/* Allocates ObjectProperties for n_values properties of the object
+   at narg.  The properties are owned by the guard pushed to the
+   stack, so that they are released also when marshalling fails. */
+static ObjectProperties *
+object_properties_new (lua_State *L, int narg, size_t n_values)
+{
+  gpointer *guard;
+  ObjectProperties *props;
+  GObject *object = object_get (L, narg);
+  if (n_values > G_MAXUINT / sizeof (GValue))
+    luaL_error (L, "too many properties");
+
+  guard = lgi_guard_create (L, (GDestroyNotify) object_properties_free);
+  props = g_new0 (ObjectProperties, 1);
+  *guard = props;
+  props->object = object;
+  props->n_properties = n_values;
+  props->names = g_new0 (const char *, n_values);
+  props->values = g_new0 (GValue, n_values);
+  return props;
+}
+
+/* Releases ObjectProperties owned by the guard on the top of the
+   stack and pops the guard. */
+static void
+object_properties_release (lua_State *L)
+{
+  gpointer *guard = lua_touserdata (L, -1);
+  object_properties_free (*guard);
+  *guard = NULL;
+  lua_pop (L, 1);
+}
+
+/* Finds pspec of the object property named by the value at narg,
+   raises an error if there is no such property or it does not allow
+   requested access. */
+static GParamSpec *
+object_find_property (lua_State *L, GObject *object, int narg,
+		      gboolean writable)
+{
+  const char *name = (lua_type (L, narg) == LUA_TSTRING)
+    ? lua_tostring (L, narg) : NULL;
+  GParamSpec *pspec = name ? g_object_class_find_property
+    (G_OBJECT_GET_CLASS (object), name) : NULL;
+  if (pspec == NULL)
+    luaL_error (L, "%s: no property `%s'", G_OBJECT_TYPE_NAME (object),
+		name ? name : luaL_typename (L, narg));
+  if (writable ? (!(pspec->flags & G_PARAM_WRITABLE)
+		  || (pspec->flags & G_PARAM_CONSTRUCT_ONLY))
+      : !(pspec->flags & G_PARAM_READABLE))
+    luaL_error (L, "%s: property `%s' is not %s",
+		G_OBJECT_TYPE_NAME (object), name,
+		writable ? "writable" : "readable");
+  return pspec;
+}
+
+/* Marshals the value which cannot be marshalled natively by fallback
+   marshaller at stack index fallback, invoked as fallback(value[,
+   luavalue]).  If narg is 0, the value is read and pushed to the
+   stack, otherwise the value is set from Lua value at narg. */
+static void
+object_value_fallback (lua_State *L, int fallback, GValue *value, int narg)
+{
+  lua_pushvalue (L, fallback);
+  lgi_type_get_repotype (L, G_TYPE_VALUE, NULL);
+  lgi_record_2lua (L, value, FALSE, 0);
+  if (narg)
+    {
+      lua_pushvalue (L, narg);
+      lua_call (L, 2, 0);
+    }
+  else
+    lua_call (L, 1, 1);
+}
+
+/* Sets all properties from the table at once, notifications are
+   emitted after all properties are set.  Values which cannot be
+   marshalled natively are set by fallback(value, luavalue).  Lua-side
+   prototype:
+   object.set_properties(obj, { name = value }, fallback) */
+static int
+object_set_properties (lua_State *L)
+{
+  ObjectProperties *props;
+  GParamSpec *pspec;
+  size_t n_values = 0;
+  guint i = 0;
+
+  luaL_checktype (L, 2, LUA_TTABLE);
+  lua_settop (L, 3);
+  lua_pushnil (L);
+  while (lua_next (L, 2) != 0)
+    {
+      n_values++;
+      lua_pop (L, 1);
+    }
+  props = object_properties_new (L, 1, n_values);
+
+  /* Marshal the values, they are owned by the guard on the top of the
+     stack until they are set. */
+  lua_pushnil (L);
+  while (lua_next (L, 2) != 0)
+    {
+      pspec = object_find_property (L, props->object, -2, TRUE);
+      props->names[i] = g_param_spec_get_name (pspec);
+      g_value_init (&props->values[i], G_PARAM_SPEC_VALUE_TYPE (pspec));
+      if (!lgi_marshal_value_2c (L, -1, &props->values[i]))
+	object_value_fallback (L, 3, &props->values[i], lua_gettop (L));
+      lua_pop (L, 1);
+      i++;
+    }
+
+#if GLIB_CHECK_VERSION(2, 54, 0)
+  g_object_setv (props->object, i, props->names, props->values);
+#else
+  g_object_freeze_notify (props->object);
+  for (n_values = 0; n_values < i; n_values++)
+    g_object_set_property (props->object, props->names[n_values],
+			   &props->values[n_values]);
+  g_object_thaw_notify (props->object);
+#endif
+
+  object_properties_release (L);
+  return 0;
+}
+
+/* Gets properties with names from the array, returns table mapping
+   the names to values.  Values which cannot be marshalled natively
+   are read by fallback(value).  Lua-side prototype:
+   values = object.get_properties(obj, { name }, fallback) */
+static int
+object_get_properties (lua_State *L)
+{
+  ObjectProperties *props;
+  GParamSpec *pspec;
+  guint i;
+
+  luaL_checktype (L, 2, LUA_TTABLE);
+  lua_settop (L, 3);
+  props = object_properties_new (L, 1, lua_objlen (L, 2));
+  for (i = 0; i < props->n_properties; i++)
+    {
+      lua_rawgeti (L, 2, i + 1);
+      pspec = object_find_property (L, props->object, -1, FALSE);
+      props->names[i] = g_param_spec_get_name (pspec);
+      g_value_init (&props->values[i], G_PARAM_SPEC_VALUE_TYPE (pspec));
+      lua_pop (L, 1);
+    }
+
+#if GLIB_CHECK_VERSION(2, 54, 0)
+  g_object_getv (props->object, props->n_properties, props->names,
+		 props->values);
+#else
+  for (i = 0; i < props->n_properties; i++)
+    g_object_get_property (props->object, props->names[i],
+			   &props->values[i]);
+#endif
+
+  lua_createtable (L, 0, props->n_properties);
+  for (i = 0; i < props->n_properties; i++)
+    {
+      lua_rawgeti (L, 2, i + 1);
+      if (!lgi_marshal_value_2lua (L, &props->values[i]))
+	object_value_fallback (L, 3, &props->values[i], 0);
+      lua_rawset (L, -3);
+    }
+
+  /* Release the values, keeping only the result table. */
+  lua_insert (L, -2);
+  object_properties_release (L);
+  return 1;
+}
+
 /* Object API table. */
 static const luaL_Reg object_api_reg[] = {
   { "query", object_query },
+  { "release", object_release },
   { "field", object_field },
+  { "access_field", object_access_field },
   { "new", object_new },
+  { "construct", object_construct },
+  { "set_properties", object_set_properties },
+  { "get_properties", object_get_properties },
   { "env", object_env },
   { NULL, NULL }
 };
@@ -590,7 +1212,7 @@ static const luaL_Reg object_api_reg[] = {
 void
 lgi_object_init (lua_State *L)
 {
-  char *id;
+  ObjectToggle *data;
 
   /* Register metatable. */
   lua_pushlightuserdata (L, &object_mt);
@@ -601,28 +1223,27 @@ lgi_object_init (lua_State *L)
   /* Initialize object cache. */
   lgi_cache_create (L, &cache, "v");
 
-  /* Create table for 'env' tables. */
-  lua_pushlightuserdata (L, &env);
+  /* Create cache of construction property pspecs. */
+  lua_pushlightuserdata (L, &construct_cache);
   lua_newtable (L);
+  lua_rawset (L, LUA_REGISTRYINDEX);
 
-  /* Add OBJECT_QDATA_ENV quark to env table. */
-  id = g_strdup_printf ("lgi:%p", L);
-  lua_pushinteger (L, g_quark_from_string (id));
-  g_free (id);
-  lua_rawseti (L, -2, OBJECT_QDATA_ENV);
-
-  /* Add OBJECT_QDATA_THREAD to env table. */
-  lua_newthread (L);
-  lua_rawseti (L, -2, OBJECT_QDATA_THREAD);
-
-  /* Add 'env' table to the registry. */
+  /* Create table anchoring proxies of objects which are referenced
+     also from outside of Lua. */
+  lua_pushlightuserdata (L, &anchor);
+  lua_newtable (L);
   lua_rawset (L, LUA_REGISTRYINDEX);
 
-  /* Register env_mt table. */
-  lua_pushlightuserdata (L, &env_mt);
+  /* Create data for toggle references, with dedicated thread used by
+     toggle notifications.  The thread is kept alive by the env table
+     of the data userdata. */
+  lua_pushlightuserdata (L, &toggle);
+  data = lua_newuserdata (L, sizeof (ObjectToggle));
   lua_newtable (L);
-  lua_pushcfunction (L, object_env_guard_gc);
-  lua_setfield (L, -2, "__gc");
+  data->L = lua_newthread (L);
+  lua_rawseti (L, -2, 1);
+  lua_setfenv (L, -2);
+  data->state_lock = lgi_state_get_lock (L);
   lua_rawset (L, LUA_REGISTRYINDEX);
 
   /* Create object API table and set it to the parent. */
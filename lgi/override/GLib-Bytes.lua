@@ -12,11 +12,18 @@ local select, type, pairs, tostring, setmetatable, error, assert
    = select, type, pairs, tostring, setmetatable, error, assert
 
 local lgi = require 'lgi'
+local core = require 'lgi.core'
 local GLib = lgi.GLib
 local Bytes = GLib.Bytes
 
 -- Define length querying operation.
 Bytes._len = Bytes.get_size
 
--- Add support for querying bytes attribute
-Bytes._attribute = { data = { get = Bytes.get_data } }
+-- Report size of the data to the garbage collector.
+Bytes._memsize = core.gi.GLib.Bytes.methods.get_size
+
+-- Add support for querying bytes attribute; 'data' copies the
+-- contents into a string, 'buffer' is read-only bytes buffer sharing
+-- the memory of the instance.
+Bytes._attribute = { data = { get = Bytes.get_data },
+		     buffer = { get = core.bytes.view } }
@@ -9,7 +9,8 @@
 --
 ------------------------------------------------------------------------------
 
-local type, pairs, ipairs, unpack = type, pairs, ipairs, unpack or table.unpack
+local type, pairs, ipairs, setmetatable, unpack
+   = type, pairs, ipairs, setmetatable, unpack or table.unpack
 
 local core = require 'lgi.core'
 local gi = core.gi
@@ -128,9 +129,37 @@ function CallInfo.new(callable_info, to_lua)
 	 self.ret = ret
       end
    end
+
+   -- Mark calls which have only input arguments and no array length
+   -- relations; closures for these are marshalled natively.
+   self.simple = not self.phantom and not (self.ret and self.ret.len_index)
+   for i = 1, #self do
+      if self[i].dir ~= 'in' or self[i].len_index or self[i].internal then
+	 self.simple = false
+      end
+   end
    return self
 end
 
+-- Compiled CallInfos are immutable, so they are cached per callable
+-- info and marshalling direction.
+local call_infos = {
+   [false] = setmetatable({}, { __mode = 'k' }),
+   [true] = setmetatable({}, { __mode = 'k' }),
+}
+
+-- Gets compiled CallInfo for given callable_info, compiling it on the
+-- first request.
+function CallInfo.get(callable_info, to_lua)
+   local cache = call_infos[to_lua and true or false]
+   local call_info = cache[callable_info]
+   if not call_info then
+      call_info = CallInfo.new(callable_info, to_lua)
+      cache[callable_info] = call_info
+   end
+   return call_info
+end
+
 -- Marshal single call_info cell (either input or output).
 local function marshal_cell(
       call_info, cell, direction, args, argc,
@@ -273,21 +302,16 @@ end
 function Closure:_new(target, callback_info)
    local closure = Closure._method.new_simple(closure_info.size, nil)
    if target then
-      local marshaller
-      if callback_info then
-	 -- Create marshaller based on callinfo.
-	 local call_info = CallInfo.new(callback_info, true)
-	 marshaller = call_info:get_closure_marshaller(target)
+      local call_info = callback_info and CallInfo.get(callback_info, true)
+      if not call_info or call_info.simple then
+	 -- Use shared native marshaller, which converts arguments
+	 -- either using compiled call_info or according to Value types.
+	 core.marshal.closure_set_target(closure, target, call_info)
       else
-	 -- Create marshaller based only on Value types.
-	 function marshaller(closure, retval, params)
-	    local args = {}
-	    for i, val in ipairs(params) do args[i] = val.value end
-	    local ret = target(unpack(args, 1, #params))
-	    if retval then retval.value = ret end
-	 end
+	 -- Create marshaller based on callinfo.
+	 core.marshal.closure_set_marshal(
+	    closure, call_info:get_closure_marshaller(target))
       end
-      core.marshal.closure_set_marshal(closure, marshaller)
    end
    Closure.ref(closure)
    Closure.sink(closure)
@@ -12,6 +12,7 @@ local pairs, select, setmetatable, error, type
    = pairs, select, setmetatable, error, type
 
 local core = require 'lgi.core'
+local class = require 'lgi.class'
 local gi = core.gi
 local repo = core.repo
 local ffi = require 'lgi.ffi'
@@ -35,21 +36,13 @@ function TypeClass:_new()
    return core.record.new(self, ptr, true)
 end
 
--- Object constructor, 'param' contains table _with properties/signals
--- to initialize.
-local parameter_repo = repo.GObject.Parameter
--- Before GLib 2.54, g_object_newv() was annotated with [rename-to g_object_new].
--- Starting from GLib 2.54, g_object_new_with_properties() has this annotation.
--- We always want g_object_newv().
-local object_new = gi.GObject.Object.methods.newv or gi.GObject.Object.methods.new
-if object_new then
-   object_new = core.callable.new(object_new)
-else
-   -- Unfortunately, older GI (<1.30) does not export g_object_newv()
-   -- in the typelib, so we have to workaround here with manually
-   -- implemented C version.
-   object_new = core.object.new
-end
+-- Construction properties resolved per class.  construct_names maps
+-- names of construction arguments to canonical property names (false
+-- for arguments which are not properties), construct_marshallers maps
+-- canonical property names to Value marshallers, used for values
+-- which cannot be marshalled natively.
+local construct_names = setmetatable({}, { __mode = 'k' })
+local construct_marshallers = setmetatable({}, { __mode = 'k' })
 
 -- Generic construction method.
 function Object:_construct(gtype, param, owns)
@@ -70,37 +63,41 @@ function Object:_construct(gtype, param, owns)
    if object then return object end
 
    -- Process 'args' table, separate properties from other fields.
-   local parameters, others, safe = {}, {}, {}
+   local names = construct_names[self]
+   if not names then
+      names = {}
+      construct_names[self] = names
+      construct_marshallers[self] = {}
+   end
+   local marshallers = construct_marshallers[self]
+   local properties, others, count = {}, {}, 0
    for name, arg in pairs(param or {}) do
       if type(name) == 'string' then
-    local argtype = self[name]
-	 if gi.isinfo(argtype) and argtype.is_property then
-	    local parameter = core.record.new(parameter_repo)
-       local propname = argtype.name
-	    local value = parameter.value
-
-	    -- Store the name string in some safe Lua place ('safe'
-	    -- table), because param is GParameter, which contains
-	    -- only non-owning pointer to the string, and it could be
-	    -- Lua-GC'ed while still referenced by GParameter
-	    -- instance.
-       safe[#safe + 1] = propname
-	    safe[#safe + 1] = value
-
-       parameter.name = propname
-	    local gtype = Type.from_typeinfo(argtype.typeinfo)
-	    Value.init(value, gtype)
-	    local marshaller = Value.find_marshaller(gtype, argtype.typeinfo)
-	    marshaller(value, nil, arg)
-	    parameters[#parameters + 1] = parameter
+	 local propname = names[name]
+	 if propname == nil then
+	    -- Resolve the argument on its first use in this class.
+	    local argtype = self[name]
+	    propname = gi.isinfo(argtype) and argtype.is_property
+	       and argtype.name or false
+	    if propname then
+	       local typeinfo = argtype.typeinfo
+	       marshallers[propname] = Value.find_marshaller(
+		  Type.from_typeinfo(typeinfo), typeinfo)
+	    end
+	    names[name] = propname
+	 end
+	 if propname then
+	    properties[propname] = arg
+	    count = count + 1
 	 else
 	    others[name] = arg
 	 end
       end
    end
 
-   -- Create the object.
-   object = object_new(gtype, parameters)
+   -- Create the object, construction properties are marshalled
+   -- natively.
+   object = core.object.construct(gtype, properties, count, marshallers)
 
    -- Perform initialization on interfaces.
    if next(self._implements) then
@@ -161,29 +158,45 @@ function Object.new(gtype, params, owns)
    end
 end
 
+-- Getters and setters of properties installed by derived classes,
+-- indexed by prop_id.  Ids are allocated globally, so that prop_id
+-- alone identifies the accessors of the property.
+local property_getters, property_setters = {}, {}
+
+-- Default accessors, mirroring the value of the property in 'priv'
+-- table of the instance.
+local function priv_getter(name)
+   return function(object) return object.priv[name] end
+end
+local function priv_setter(name)
+   return function(object, value) object.priv[name] = value end
+end
+
+-- Creates proxy of the table of custom accessors of the class, which
+-- stores accessors assigned after the properties were installed also
+-- into the array indexed by prop_id.
+local function accessors_proxy(custom, accessors, ids, default)
+   return setmetatable({}, {
+      __index = custom,
+      __newindex = function(_, name, accessor)
+	 custom[name] = accessor
+	 local prop_id = ids[name]
+	 if prop_id then accessors[prop_id] = accessor or default(name) end
+      end,
+   })
+end
+
 -- Prepare callbacks for get_property and set_property
 local get_property_guard, get_property_addr = core.marshal.callback(
    gi.GObject.ObjectClass.fields.get_property.typeinfo.interface,
-   function(self, prop_id, value, pspec)
-      local name = pspec.name:gsub('%-', '_')
-      local prop_get = core.object.query(self, 'repo')._property_get[name]
-      if prop_get then
-	 value.value = prop_get(self)
-      else
-	 value.value = self.priv[name]
-      end
+   function(self, prop_id, value)
+      value.value = property_getters[prop_id](self)
 end)
 
 local set_property_guard, set_property_addr = core.marshal.callback(
    gi.GObject.ObjectClass.fields.get_property.typeinfo.interface,
-   function(self, prop_id, value, pspec)
-      local name = pspec.name:gsub('%-', '_')
-      local prop_set = core.object.query(self, 'repo')._property_set[name]
-      if prop_set then
-	 prop_set(self, value.value)
-      else
-	 self.priv[name] = value.value
-      end
+   function(self, prop_id, value)
+      property_setters[prop_id](self, value.value)
 end)
 
 if not core.guards then core.guards = {} end
@@ -203,12 +216,22 @@ function Object:_class_init(class)
 	 class.set_property = set_property_addr
       end
 
-      -- Install properties.
-      local prop_id = 0
-      for name, pspec in pairs(self._property) do
-	 prop_id = prop_id + 1
+      -- Install properties, resolving their accessors.
+      local ids = {}
+      for _, pspec in pairs(self._property) do
+	 local prop_id = #property_getters + 1
+	 local name = pspec.name:gsub('%-', '_')
+	 ids[name] = prop_id
+	 property_getters[prop_id] = self._property_get[name]
+	    or priv_getter(name)
+	 property_setters[prop_id] = self._property_set[name]
+	    or priv_setter(name)
 	 class:install_property(prop_id, pspec)
       end
+      rawset(self, '_property_get', accessors_proxy(
+		self._property_get, property_getters, ids, priv_getter))
+      rawset(self, '_property_set', accessors_proxy(
+		self._property_set, property_setters, ids, priv_setter))
    end
 end
 
@@ -227,90 +250,195 @@ function Object._attribute._type:get()
 end
 
 -- Custom _element implementation, checks dynamically inherited
--- interfaces and dynamic properties.
+-- interfaces and dynamic properties.  Elements found this way depend
+-- only on the real GType of the instance, so they are cached per
+-- GType in dynamic_elements table, until the epoch of flattened
+-- elements becomes stale.
 local inherited_element = Object._element
+local dynamic_elements = {}
 function Object:_element(object, name)
-   local element, category = inherited_element(self, object, name)
-   if element then return element, category end
+   local element, category, owner = inherited_element(self, object, name)
+   if element then return element, category, owner end
 
    -- Everything else works only if we have object instance.
    if not object then return nil end
 
+   -- Check, whether the element was already resolved for this GType.
+   local gtype = object._gtype
+   local cache = dynamic_elements[gtype]
+   element = cache and cache[name]
+   if element and not element[3].stale then return element[1], element[2] end
+
    -- List all interfaces implemented by this object and try whether
    -- they can handle specified _element request.
-   local interfaces = Type.interfaces(object._gtype)
+   local interfaces = Type.interfaces(gtype)
    for i = 1, #interfaces do
       local info = gi[core.gtype(interfaces[i])]
       local iface = info and repo[info.namespace][info.name]
-      if iface then element, category = iface:_element(object, name, self) end
-      if element then return element, category end
+      if iface then
+	 element, category, owner = iface:_element(object, name, self)
+      end
+      if element then break end
    end
 
    -- Element not found in the repo (typelib), try whether dynamic
    -- property of the specified name exists.
-   local property = Object._class.find_property(
-      object._class, name:gsub('_', '-'))
-   if property then return property, '_property' end
-end
-
--- Sets/gets property using specified marshaller attributes.
-local function marshal_property(obj, name, flags, gtype, marshaller, ...)
-   -- Check access rights of the property.
-   local mode = select('#', ...) > 0 and 'WRITABLE' or 'READABLE'
-   if not flags[mode] then
-      error(("%s: `%s' not %s"):format(core.object.query(obj, 'repo')._name,
-				       name, core.downcase(mode)))
+   if not element then
+      element = Object._class.find_property(
+	 object._class, name:gsub('_', '-'))
+      if not element then return nil end
+      category, owner = '_property', Object
    end
-   local value = Value(gtype)
-   if mode == 'WRITABLE' then
-      marshaller(value, nil, ...)
-      Object.set_property(obj, name, value)
-   else
-      Object.get_property(obj, name, value)
-      return marshaller(value)
+
+   -- Cache only elements with known owner; the rest might depend on
+   -- the instance itself.
+   if owner then
+      if not cache then
+	 cache = {}
+	 dynamic_elements[gtype] = cache
+      end
+      cache[name] = { element, category, class.flatten(name) }
    end
+   return element, category
 end
 
+-- Compiled property accessors, indexed by property element (either GI
+-- property info or ParamSpec).  Accessors cache GParamSpec of the
+-- property and marshal simple values natively, using Value
+-- marshaller only for the rest.
+local property_accessors = setmetatable({}, { __mode = 'k' })
+
 -- Property accessor.
 function Object:_access_property(object, prop, ...)
-   if gi.isinfo(prop) then
-      -- GI-based property
-      local typeinfo = prop.typeinfo
-      local gtype = Type.from_typeinfo(typeinfo)
-      local marshaller = Value.find_marshaller(gtype, typeinfo,
-					       prop.transfer)
-      return marshal_property(object, prop.name,
-			      repo.GObject.ParamFlags[prop.flags],
-			      gtype, marshaller, ...)
-   else
-      -- pspec-based property
-      return marshal_property(object, prop.name, prop.flags, prop.value_type,
-			      Value.find_marshaller(prop.value_type), ...)
+   local accessor = property_accessors[prop]
+   if not accessor then
+      local marshaller
+      if gi.isinfo(prop) then
+	 -- GI-based property
+	 local typeinfo = prop.typeinfo
+	 marshaller = Value.find_marshaller(Type.from_typeinfo(typeinfo),
+					    typeinfo, prop.transfer)
+      else
+	 -- pspec-based property
+	 marshaller = Value.find_marshaller(prop.value_type)
+      end
+      accessor = core.marshal.property(prop.name, marshaller)
+      property_accessors[prop] = accessor
+   end
+   return accessor(object, ...)
+end
+
+-- Fallback marshaller of bulk property access, used for values which
+-- cannot be marshalled natively.
+local function property_value(value, ...)
+   if select('#', ...) == 0 then return value.value end
+   value.value = ...
+end
+
+-- Checks whether the element of given name is plain property, which
+-- can be accessed in bulk natively.  Other elements (attributes and
+-- elements provided by overrides) are accessed by ordinary indexing.
+-- Unknown names are refused before any element is accessed.
+local function is_native_property(object, name)
+   local typetable = object._type
+   local element, category = typetable:_element(object, name)
+   if not element then
+      error(("%s: no `%s'"):format(typetable._name, tostring(name)), 3)
+   end
+   return category == '_property'
+end
+
+-- Sets all properties from the table at once.  Change notifications
+-- are emitted after all properties are set, so that every changed
+-- property is notified only once.
+function Object._method:set_properties(values)
+   local properties, others = {}, {}
+   for name, value in pairs(values) do
+      if is_native_property(self, name) then
+	 properties[name] = value
+      else
+	 others[name] = value
+      end
+   end
+   core.object.set_properties(self, properties, property_value)
+   for name, value in pairs(others) do self[name] = value end
+end
+
+-- Gets properties with names from given array, returns table mapping
+-- names to property values.
+function Object._method:get_properties(names)
+   local properties, others = {}, {}
+   for i = 1, #names do
+      local name = names[i]
+      if is_native_property(self, name) then
+	 properties[#properties + 1] = name
+      else
+	 others[#others + 1] = name
+      end
    end
+   local values = core.object.get_properties(self, properties,
+					     property_value)
+   for i = 1, #others do values[others[i]] = self[others[i]] end
+   return values
 end
 
 local quark_from_string = repo.GLib.quark_from_string
 local signal_lookup = repo.GObject.signal_lookup
 local signal_connect_closure_by_id = repo.GObject.signal_connect_closure_by_id
 local signal_emitv = repo.GObject.signal_emitv
--- Connects signal to specified object instance.
-local function connect_signal(obj, gtype, name, closure, detail, after)
+
+-- Caches of signal ids (indexed by gtype and signal name) and detail
+-- quarks (indexed by detail string).  Only successful lookups are
+-- cached, because signals of the type might not be registered yet.
+local signal_ids, detail_quarks = {}, {}
+local function get_signal_id(name, gtype)
+   local ids = signal_ids[gtype]
+   local id = ids and ids[name]
+   if not id then
+      id = signal_lookup(name, gtype)
+      if id ~= 0 then
+	 if not ids then
+	    ids = {}
+	    signal_ids[gtype] = ids
+	 end
+	 ids[name] = id
+      end
+   end
+   return id
+end
+local function get_detail_quark(detail)
+   if not detail then return 0 end
+   local quark = detail_quarks[detail]
+   if not quark then
+      quark = quark_from_string(detail)
+      detail_quarks[detail] = quark
+   end
+   return quark
+end
+
+-- Connects target to the signal of specified object instance.  The
+-- closure is created for this connection only and is owned by the
+-- object, so that handlers referencing their object do not keep it
+-- alive.
+local closure_set_owner = core.marshal.closure_set_owner
+local function connect_signal(obj, gtype, info, target, detail, after)
+   local closure = Closure(target, info)
+   closure_set_owner(closure, obj)
    return signal_connect_closure_by_id(
-      obj, signal_lookup(name, gtype),
-      detail and quark_from_string(detail) or 0,
+      obj, get_signal_id(info.name, gtype), get_detail_quark(detail),
       closure, after or false)
 end
 -- Emits signal on specified object instance.
 local function emit_signal(obj, gtype, info, detail, ...)
-   -- Compile callable info.
-   local call_info = Closure.CallInfo.new(info)
+   -- Get compiled callable info.
+   local call_info = Closure.CallInfo.get(info)
 
    -- Marshal input arguments.
    local retval, params, marshalling_params = call_info:pre_call(obj, ...)
 
    -- Invoke the signal.
-   signal_emitv(params, signal_lookup(info.name, gtype),
-		detail and quark_from_string(detail) or 0, retval)
+   signal_emitv(params, get_signal_id(info.name, gtype),
+		get_detail_quark(detail), retval)
 
    -- Unmarshal results.
    return call_info:post_call(params, retval, marshalling_params)
@@ -321,14 +449,13 @@ function Object:_access_signal(object, info, ...)
    local gtype = self._gtype
    if select('#', ...) > 0 then
       -- Assignment means 'connect signal without detail'.
-      connect_signal(object, gtype, info.name, Closure((...), info))
+      connect_signal(object, gtype, info, (...))
    else
       -- Reading yields table with signal operations.
       local mt = {}
       local pad = setmetatable({}, mt)
       function pad:connect(target, detail, after)
-	 return connect_signal(object, gtype, info.name,
-			       Closure(target, info), detail, after)
+	 return connect_signal(object, gtype, info, target, detail, after)
       end
       function pad:emit(...)
 	 return emit_signal(object, gtype, info, nil, ...)
@@ -345,8 +472,7 @@ function Object:_access_signal(object, info, ...)
 	    return emit_signal(object, gtype, info, detail, ...)
 	 end
 	 function mt:__newindex(detail, target)
-	    connect_signal(object, gtype, info.name, Closure(target, info),
-			   detail)
+	    connect_signal(object, gtype, info, target, detail)
 	 end
       end
 
@@ -138,6 +138,22 @@ end
 value_marshallers[Type.STRV] = core.marshal.container(
    gi.GLib.shell_parse_argv.args[3].typeinfo)
 
+-- Marshal values of fundamental types natively, Lua marshallers are
+-- used only for values which cannot be handled natively.
+for _, name in pairs { 'BOOLEAN', 'CHAR', 'UCHAR', 'INT', 'UINT', 'LONG',
+		       'ULONG', 'INT64', 'UINT64', 'FLOAT', 'DOUBLE',
+		       'STRING', 'ENUM', 'FLAGS', 'OBJECT', 'BOXED',
+		       'VARIANT', 'POINTER' } do
+   local gtype = Type[name]
+   local marshaller = value_marshallers[gtype]
+   if marshaller then
+      value_marshallers[gtype] = core.marshal.value(marshaller)
+   end
+end
+
+-- Marshallers found for gtypes by walking their parents.
+local gtype_marshallers = {}
+
 -- Finds marshaller closure which can marshal type described either by
 -- gtype or typeinfo/transfer combo.
 function Value._method.find_marshaller(gtype, typeinfo, transfer)
@@ -188,10 +204,16 @@ function Value._method.find_marshaller(gtype, typeinfo, transfer)
    if not gt then return function() end end
 
    -- Find marshaller according to gtype of the value.
+   marshaller = gtype_marshallers[gt]
+   if marshaller then return marshaller end
+   local name = gt
    while gt do
       -- Check simple and/or fundamental marshallers.
       marshaller = value_marshallers[gt] or core.marshal.fundamental(gt)
-      if marshaller then return marshaller end
+      if marshaller then
+	 gtype_marshallers[name] = marshaller
+	 return marshaller
+      end
       gt = Type.parent(gt)
    end
    error(("GValue marshaller for `%s' not found"):format(tostring(gtype)))
@@ -0,0 +1,20 @@
+------------------------------------------------------------------------------
+--
+--  LGI GdkPixbuf override module.
+--
+--  Copyright (c) 2026 lgi contributors
+--  Licensed under the MIT license:
+--  http://www.opensource.org/licenses/mit-license.php
+--
+------------------------------------------------------------------------------
+
+local lgi = require 'lgi'
+local core = require 'lgi.core'
+
+local GdkPixbuf = lgi.GdkPixbuf
+
+-- Report size of pixel data to the garbage collector.
+local get_byte_length = core.gi.GdkPixbuf.Pixbuf.methods.get_byte_length
+if get_byte_length then
+   GdkPixbuf.Pixbuf._memsize = get_byte_length
+end
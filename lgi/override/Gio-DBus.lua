@@ -8,8 +8,8 @@
 --
 ------------------------------------------------------------------------------
 
-local pairs, ipairs
-   = pairs, ipairs
+local pairs, ipairs, type, setmetatable
+   = pairs, ipairs, type, setmetatable
 
 local lgi = require 'lgi'
 local core = require 'lgi.core'
@@ -80,3 +80,106 @@ if core.gi.Gio.DBusProxy.methods.get_interface_info.return_transfer ~= 'none' th
       core.gi.Gio.DBusProxy.methods.new_sync.return_type,
    }
 end
+
+-- Compiled proxy stubs.  Encoders and decoders of arguments of all
+-- methods of the interface are compiled natively from their
+-- signatures once, so that calls neither parse signatures nor touch
+-- GLib.Variant instances in Lua.
+function Gio.DBusInterfaceInfo:compile()
+   -- Methods live in their own table, apart from members of the stub
+   -- itself, so that D-Bus methods like 'new' do not clash with them.
+   -- Instance state is kept under private key for the same reason.
+   local interface, methods, state = self.name, {}, {}
+   local stub = { _info = self, _interface = interface }
+   local instance_mt = { __index = methods }
+
+   -- Creates stub instance for the object on the connection.
+   function stub.new(connection, name, path, flags, timeout)
+      return setmetatable({ [state] = {
+	    connection = connection, name = name, path = path,
+	    flags = flags or Gio.DBusCallFlags.NONE, timeout = timeout or -1,
+      } }, instance_mt)
+   end
+
+   for _, method in ipairs(self.methods) do
+      local name, in_signature, out_signature = method.name, '', ''
+      for _, arg in ipairs(method.in_args) do
+	 in_signature = in_signature .. arg.signature
+      end
+      for _, arg in ipairs(method.out_args) do
+	 out_signature = out_signature .. arg.signature
+      end
+      local encode = core.marshal.variant_codec(in_signature)
+      local _, decode = core.marshal.variant_codec(out_signature)
+      local reply_type = GLib.VariantType.new('(' .. out_signature .. ')')
+
+      -- Unpacks reply into multiple results, methods without results
+      -- return true on success.
+      local function finish(reply, err)
+	 if not reply then return nil, err end
+	 if out_signature == '' then return true end
+	 return decode(reply)
+      end
+
+      methods[name] = function(self, ...)
+	 local s = self[state]
+	 return finish(s.connection:call_sync(
+			  s.name, s.path, interface, name,
+			  encode(...), reply_type, s.flags, s.timeout))
+      end
+      methods['async_' .. name] = function(self, ...)
+	 local s = self[state]
+	 return finish(s.connection:async_call(
+			  s.name, s.path, interface, name,
+			  encode(...), reply_type, s.flags, s.timeout))
+      end
+   end
+   return stub
+end
+
+-- Compiles stubs of all interfaces of the node, which can be given
+-- also as XML string.  Returns table of stubs indexed by interface
+-- names.
+function Gio.DBusNodeInfo:compile()
+   if type(self) == 'string' then
+      local node, err = Gio.DBusNodeInfo.new_for_xml(self)
+      if not node then return nil, err end
+      self = node
+   end
+   local stubs = {}
+   for _, interface in ipairs(self.interfaces) do
+      stubs[interface.name] = interface:compile()
+   end
+   return stubs
+end
+
+-- Native registration of exported objects.  Vtable and its
+-- user_data_free_func are provided by core.marshal.dbus_export().
+local register_object = core.callable.new {
+   name = 'Gio.DBusConnection.register_object',
+   addr = core.gi.Gio.resolve.g_dbus_connection_register_object,
+   ret = ti.uint, Gio.DBusConnection, ti.utf8, Gio.DBusInterfaceInfo,
+   ti.ptr, ti.ptr, ti.ptr, throws = true,
+}
+
+-- Exports object implementing the interface on the connection.
+-- Methods of the object are looked up in methods table and compiled
+-- into native dispatcher, which unpacks parameters directly into
+-- arguments of Lua methods and creates replies from their results.
+-- Returns registration id usable with unregister_object(), or nil
+-- and error.
+function Gio.DBusInterfaceInfo:export(connection, path, methods)
+   local signatures = {}
+   for _, method in ipairs(self.methods) do
+      local signature = ''
+      for _, arg in ipairs(method.out_args) do
+	 signature = signature .. arg.signature
+      end
+      signatures[method.name] = signature
+   end
+   local export, free = core.marshal.dbus_export(
+      methods, signatures,
+      core.gi.Gio.resolve.g_dbus_method_invocation_return_value,
+      core.gi.Gio.resolve.g_dbus_method_invocation_return_dbus_error)
+   return register_object(connection, path, self, export, export, free)
+end
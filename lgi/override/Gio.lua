@@ -176,8 +176,8 @@ end
 
 local inherited_class_element = class.class_mt._element
 function class.class_mt:_element(object, name)
-   local element, category = inherited_class_element(self, object, name)
-   if element then return element, category end
+   local element, category, owner = inherited_class_element(self, object, name)
+   if element then return element, category, owner end
    return async_element(name, inherited_class_element, self, object)
 end
 
@@ -187,8 +187,8 @@ end
 
 local inherited_gobject_element = GObject.Object._element
 function GObject.Object:_element(object, name)
-   local element, category = inherited_gobject_element(self, object, name)
-   if element then return element, category end
+   local element, category, owner = inherited_gobject_element(self, object, name)
+   if element then return element, category, owner end
    return async_element(name, inherited_gobject_element, self, object)
 end
 
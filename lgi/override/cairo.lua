@@ -8,8 +8,10 @@
 --
 ------------------------------------------------------------------------------
 
-local assert, pairs, ipairs, setmetatable, table, rawget, type
-   = assert, pairs, ipairs, setmetatable, table, rawget, type
+local assert, pairs, ipairs, setmetatable, table, rawget, type, error, math,
+tostring
+   = assert, pairs, ipairs, setmetatable, table, rawget, type, error, math,
+tostring
 local lgi = require 'lgi'
 local cairo = lgi.cairo
 
@@ -734,6 +736,12 @@ for _, name in pairs { 'identity', 'scale', 'rotate', 'translate' } do
    end
 end
 
+-- Transforms all points in flat array or 'bytes' buffer of doubles
+-- with alternating x and y coordinates at once.
+function cairo.Matrix._method:transform_points(points, inplace, inverse)
+   return core.cairo.matrix_transform(self, points, inplace, inverse)
+end
+
 -- FontOptions can be created only by 'create' method.
 function cairo.FontOptions._method:_new(props)
    local font_options = self.create()
@@ -807,6 +815,112 @@ function cairo.Surface:_attach(surface)
    end
 end
 
+-- Report size of image data of image surfaces to the garbage collector.
+function cairo.ImageSurface._memsize(surface)
+   local method = cairo.ImageSurface._method
+   return method.get_stride(surface) * method.get_height(surface)
+end
+
+-- Pixel access to image surfaces.  Pixels instance is a view of the
+-- data of 32-bit surface, which keeps the surface alive.  Pixel
+-- values are integers 0xAARRGGBB with premultiplied alpha.  Bulk
+-- operations are performed natively and take care of flushing the
+-- surface before reading and marking it dirty after writing.
+local Pixels = {}
+Pixels.__index = Pixels
+
+-- Accessors of the pixel data, used by core.pixels.buffer().
+for _, name in ipairs { 'get_data', 'get_stride', 'get_height' } do
+   cairo.ImageSurface['_' .. name] =
+      cairo._module['cairo_image_surface_' .. name]
+end
+
+function cairo.ImageSurface._method.get_pixels(surface)
+   local method = cairo.ImageSurface._method
+   local format = method.get_format(surface)
+   if format ~= 'ARGB32' and format ~= 'RGB24' then
+      error(("cairo.ImageSurface: pixels of format `%s' not supported")
+	    :format(tostring(format)), 2)
+   end
+   cairo.Surface._method.flush(surface)
+   local stride, height = method.get_stride(surface), method.get_height(surface)
+   return setmetatable({
+	 surface = surface, width = method.get_width(surface),
+	 height = height, stride = stride, opaque = format == 'RGB24',
+	 buffer = core.pixels.buffer(surface),
+   }, Pixels)
+end
+
+-- Clips rectangle (defaulting to the whole surface) to the surface.
+local function clip_rectangle(pixels, x, y, width, height)
+   x, y = x or 0, y or 0
+   local x2 = math.min(x + (width or pixels.width), pixels.width)
+   local y2 = math.min(y + (height or pixels.height), pixels.height)
+   x, y = math.max(x, 0), math.max(y, 0)
+   return x, y, math.max(x2 - x, 0), math.max(y2 - y, 0)
+end
+
+local function pixel_position(pixels, x, y)
+   if x < 0 or x >= pixels.width or y < 0 or y >= pixels.height then
+      error(("cairo.Pixels: position %d, %d out of surface"):format(x, y), 3)
+   end
+   return y * pixels.stride + x * 4 + 1
+end
+
+function Pixels:get(x, y)
+   cairo.Surface._method.flush(self.surface)
+   return self.buffer:get_uint32(pixel_position(self, x, y))
+end
+
+function Pixels:set(x, y, pixel)
+   self.buffer:set_uint32(pixel_position(self, x, y), pixel)
+   cairo.Surface._method.mark_dirty_rectangle(self.surface, x, y, 1, 1)
+end
+
+-- Fills rectangle (clipped to the surface) with the pixel value.
+function Pixels:fill_rect(x, y, width, height, pixel)
+   x, y, width, height = clip_rectangle(self, x, y, width, height)
+   core.pixels.fill(self.buffer, self.stride, x, y, width, height, pixel)
+   cairo.Surface._method.mark_dirty_rectangle(
+      self.surface, x, y, width, height)
+end
+
+-- Copies rows of pixels from source string or buffer into the
+-- rectangle, which must lie inside the surface.
+function Pixels:blit(x, y, width, height, source, source_stride)
+   core.pixels.blit(self.buffer, self.stride, x, y, width, height,
+		    source, source_stride)
+   cairo.Surface._method.mark_dirty_rectangle(
+      self.surface, x, y, width, height)
+end
+
+-- Returns new bytes buffer with contents of the rectangle converted
+-- to RGBA bytes without premultiplication.
+function Pixels:to_rgba(x, y, width, height)
+   x, y, width, height = clip_rectangle(self, x, y, width, height)
+   cairo.Surface._method.flush(self.surface)
+   return core.pixels.to_rgba(self.buffer, self.stride, x, y, width, height,
+			      self.opaque)
+end
+
+-- Stores RGBA bytes without premultiplication from source string or
+-- buffer into the rectangle, which must lie inside the surface.
+function Pixels:from_rgba(x, y, width, height, source)
+   core.pixels.from_rgba(self.buffer, self.stride, x, y, width, height,
+			 source, self.opaque)
+   cairo.Surface._method.mark_dirty_rectangle(
+      self.surface, x, y, width, height)
+end
+
+-- Returns histograms of red, green, blue and alpha channels of the
+-- rectangle, as tables indexed by channel value + 1.
+function Pixels:histogram(x, y, width, height)
+   x, y, width, height = clip_rectangle(self, x, y, width, height)
+   cairo.Surface._method.flush(self.surface)
+   return core.pixels.histogram(self.buffer, self.stride,
+				x, y, width, height)
+end
+
 -- Also choose correct 'subclass' for patterns.
 local pattern_type_map = {
    SOLID = cairo.SolidPattern,
@@ -921,3 +1035,16 @@ function cairo.Path:pairs()
       return type, points
    end
 end
+
+-- Native iteration over the cairo.Path, avoiding creation of
+-- intermediate PathData proxies and points tables.  Iterator returns
+-- type of the element followed by coordinates of its points.
+function cairo.Path:iter()
+   return core.cairo.path_iter(self)
+end
+
+-- Creates new cairo.Path from flat array of element types, each
+-- followed by coordinates of its points.
+function cairo.Path.from_array(array)
+   return core.record.new(cairo.Path, core.cairo.path_new(array), true)
+end
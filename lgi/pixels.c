@@ -0,0 +1,379 @@
+/*
+ * Dynamic Lua binding to GObject using dynamic gobject-introspection.
+ *
+ * Copyright (c) 2026 lgi contributors
+ * Licensed under the MIT license:
+ * http://www.opensource.org/licenses/mit-license.php
+ *
+ * Bulk operations over 32-bit pixel data (cairo ARGB32 and RGB24
+ * formats) stored in 'bytes' buffers.  Pixels are native-endian
+ * 32-bit integers with premultiplied alpha in the highest byte.
+ */
+
+#include <string.h>
+#include "lgi.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__AVX2__)
+#include <immintrin.h>
+#endif
+
+/* Pixel rows of the image being processed. */
+typedef struct _Pixels
+{
+  guint8 *data;
+  gsize stride;
+  gint width, height;
+} Pixels;
+
+/* Gets buffer at narg, stride at narg + 1 and rectangle at narg + 2
+   to narg + 5, checks that the rectangle lies inside the buffer and
+   fills the rows of the rectangle into pixels.  If writable is set,
+   the buffer must be writable. */
+static void
+pixels_check (lua_State *L, int narg, Pixels *pixels, gboolean writable)
+{
+  gsize size;
+  lua_Integer stride, x, y, width, height, columns, rows;
+  guint8 *data = writable ? lgi_buffer_test_writable (L, narg, &size)
+    : lgi_buffer_test (L, narg, &size);
+  if (data == NULL)
+    luaL_argerror (L, narg, "bytes expected");
+
+  stride = luaL_checkinteger (L, narg + 1);
+  x = luaL_checkinteger (L, narg + 2);
+  y = luaL_checkinteger (L, narg + 3);
+  width = luaL_checkinteger (L, narg + 4);
+  height = luaL_checkinteger (L, narg + 5);
+  luaL_argcheck (L, stride > 0 && stride <= G_MAXINT, narg + 1,
+		 "bad stride");
+
+  /* Compare against the number of pixel columns and rows of the
+     buffer, without any multiplication which could overflow. */
+  columns = stride / 4;
+  rows = MIN (size / (gsize) stride, G_MAXINT);
+  luaL_argcheck (L, x >= 0 && y >= 0 && width >= 0 && height >= 0
+		 && x <= columns && width <= columns - x
+		 && y <= rows && height <= rows - y,
+		 narg + 2, "rectangle out of buffer");
+  pixels->data = data + (gsize) y * stride + x * 4;
+  pixels->stride = stride;
+  pixels->width = width;
+  pixels->height = height;
+}
+
+#if defined (__SSE2__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+/* Swaps red and blue channels of 4 pixels, which converts between
+   native-endian ARGB and RGBA byte order.  Returns FALSE when some
+   of the pixels is not opaque, unless opaque is set, in which case
+   alpha channel is forced to 255. */
+static inline gboolean
+pixels_swap_rb_4 (const void *source, void *target, gboolean opaque)
+{
+  const __m128i alpha = _mm_set1_epi32 (0xff000000);
+  const __m128i ag = _mm_set1_epi32 (0xff00ff00);
+  const __m128i low = _mm_set1_epi32 (0xff);
+  __m128i p = _mm_loadu_si128 ((const __m128i *) source);
+  if (opaque)
+    p = _mm_or_si128 (p, alpha);
+  else if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (_mm_and_si128 (p, alpha),
+					       alpha)) != 0xffff)
+    return FALSE;
+
+  p = _mm_or_si128 (_mm_and_si128 (p, ag),
+		    _mm_or_si128 (_mm_and_si128 (_mm_srli_epi32 (p, 16), low),
+				  _mm_slli_epi32 (_mm_and_si128 (p, low), 16)));
+  _mm_storeu_si128 ((__m128i *) target, p);
+  return TRUE;
+}
+#endif
+
+/* Fills rectangle with the pixel value.  Lua-side prototype:
+   core.pixels.fill(buffer, stride, x, y, width, height, pixel) */
+static int
+pixels_fill (lua_State *L)
+{
+  Pixels pixels;
+  guint32 pixel;
+  gint x, y;
+
+  pixels_check (L, 1, &pixels, TRUE);
+  pixel = (guint32) (gint64) luaL_checknumber (L, 7);
+  for (y = 0; y < pixels.height; y++)
+    {
+      guint32 *row = (guint32 *) (pixels.data + y * pixels.stride);
+      x = 0;
+#if defined (__AVX2__)
+      {
+	__m256i v = _mm256_set1_epi32 (pixel);
+	for (; x + 8 <= pixels.width; x += 8)
+	  _mm256_storeu_si256 ((__m256i *) (row + x), v);
+      }
+#endif
+#if defined (__SSE2__)
+      {
+	__m128i v = _mm_set1_epi32 (pixel);
+	for (; x + 4 <= pixels.width; x += 4)
+	  _mm_storeu_si128 ((__m128i *) (row + x), v);
+      }
+#endif
+      for (; x < pixels.width; x++)
+	row[x] = pixel;
+    }
+  return 0;
+}
+
+/* Copies pixels from the source (string or buffer) rows into the
+   rectangle.  Lua-side prototype:
+   core.pixels.blit(buffer, stride, x, y, width, height, source
+		    [, srcstride]) */
+static int
+pixels_blit (lua_State *L)
+{
+  Pixels pixels;
+  const guint8 *source;
+  gsize size, srcstride, rowsize;
+  gint y;
+
+  pixels_check (L, 1, &pixels, TRUE);
+  source = lgi_buffer_test (L, 7, &size);
+  if (source == NULL)
+    source = (const guint8 *) luaL_checklstring (L, 7, &size);
+  rowsize = pixels.width * 4;
+  srcstride = luaL_optinteger (L, 8, rowsize);
+  luaL_argcheck (L, srcstride >= rowsize, 8, "bad stride");
+  luaL_argcheck (L, pixels.height == 0 || rowsize == 0
+		 || (rowsize <= size && (gsize) (pixels.height - 1)
+		     <= (size - rowsize) / srcstride),
+		 7, "source too small");
+  for (y = 0; y < pixels.height; y++)
+    memmove (pixels.data + y * pixels.stride, source + y * srcstride,
+	     rowsize);
+  return 0;
+}
+
+/* Converts row of ARGB pixels to RGBA bytes, unpremultiplying
+   alpha.  If opaque is set, alpha channel is ignored and considered
+   to be 255. */
+static void
+pixels_row_to_rgba (const guint32 *row, guint8 *target, gint width,
+		    gboolean opaque)
+{
+  gint x, n = 0;
+  for (x = 0; x < width; x++)
+    {
+      guint32 p = row[x];
+      guint a = opaque ? 0xff : p >> 24;
+      guint8 *t = target + x * 4;
+
+#if defined (__SSE2__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+      /* Runs of opaque pixels need only swapping of red and blue
+	 channels, process them by blocks of 4. */
+      if (x >= n && x + 4 <= width)
+	{
+	  if (pixels_swap_rb_4 (row + x, t, opaque))
+	    {
+	      x += 3;
+	      continue;
+	    }
+
+	  /* Do not retry vector path for pixels of this block. */
+	  n = x + 4;
+	}
+#endif
+
+      if (a == 0xff)
+	{
+	  t[0] = p >> 16;
+	  t[1] = p >> 8;
+	  t[2] = p;
+	}
+      else if (a == 0)
+	t[0] = t[1] = t[2] = 0;
+      else
+	{
+	  t[0] = (((p >> 16) & 0xff) * 0xff + a / 2) / a;
+	  t[1] = (((p >> 8) & 0xff) * 0xff + a / 2) / a;
+	  t[2] = ((p & 0xff) * 0xff + a / 2) / a;
+	}
+      t[3] = a;
+    }
+}
+
+/* Converts row of RGBA bytes to ARGB pixels, premultiplying alpha. */
+static void
+pixels_row_from_rgba (const guint8 *source, guint32 *row, gint width,
+		      gboolean opaque)
+{
+  gint x, n = 0;
+  for (x = 0; x < width; x++)
+    {
+      const guint8 *s = source + x * 4;
+      guint a = opaque ? 0xff : s[3];
+
+#if defined (__SSE2__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+      if (x >= n && x + 4 <= width)
+	{
+	  if (pixels_swap_rb_4 (s, row + x, opaque))
+	    {
+	      x += 3;
+	      continue;
+	    }
+	  n = x + 4;
+	}
+#endif
+
+      if (a == 0xff)
+	row[x] = 0xff000000 | (s[0] << 16) | (s[1] << 8) | s[2];
+      else
+	{
+	  /* Premultiply, using exact rounded division by 255. */
+	  guint r = s[0] * a + 0x80, g = s[1] * a + 0x80, b = s[2] * a + 0x80;
+	  r = (r + (r >> 8)) >> 8;
+	  g = (g + (g >> 8)) >> 8;
+	  b = (b + (b >> 8)) >> 8;
+	  row[x] = (a << 24) | (r << 16) | (g << 8) | b;
+	}
+    }
+}
+
+/* Converts rectangle into new buffer with RGBA bytes, unpremultiplied.
+   Lua-side prototype:
+   rgba = core.pixels.to_rgba(buffer, stride, x, y, width, height
+			       [, opaque]) */
+static int
+pixels_to_rgba (lua_State *L)
+{
+  Pixels pixels;
+  guint8 *target;
+  gboolean opaque = lua_toboolean (L, 7);
+  gint y;
+
+  pixels_check (L, 1, &pixels, FALSE);
+  target = lgi_buffer_new (L, (gsize) pixels.width * pixels.height * 4);
+  for (y = 0; y < pixels.height; y++)
+    pixels_row_to_rgba ((const guint32 *) (pixels.data + y * pixels.stride),
+			target + (gsize) y * pixels.width * 4, pixels.width,
+			opaque);
+  return 1;
+}
+
+/* Stores RGBA bytes from the source (string or buffer) into the
+   rectangle, premultiplying alpha.  Lua-side prototype:
+   core.pixels.from_rgba(buffer, stride, x, y, width, height, source
+			 [, opaque]) */
+static int
+pixels_from_rgba (lua_State *L)
+{
+  Pixels pixels;
+  const guint8 *source;
+  gboolean opaque = lua_toboolean (L, 8);
+  gsize size;
+  gint y;
+
+  pixels_check (L, 1, &pixels, TRUE);
+  source = lgi_buffer_test (L, 7, &size);
+  if (source == NULL)
+    source = (const guint8 *) luaL_checklstring (L, 7, &size);
+  luaL_argcheck (L, size >= (gsize) pixels.width * pixels.height * 4, 7,
+		 "source too small");
+  for (y = 0; y < pixels.height; y++)
+    pixels_row_from_rgba (source + (gsize) y * pixels.width * 4,
+			  (guint32 *) (pixels.data + y * pixels.stride),
+			  pixels.width, opaque);
+  return 0;
+}
+
+/* Computes histograms of all channels of the rectangle.  Returns
+   four tables (red, green, blue and alpha), indexed by channel
+   value + 1.  Lua-side prototype:
+   r, g, b, a = core.pixels.histogram(buffer, stride, x, y, width, height) */
+static int
+pixels_histogram (lua_State *L)
+{
+  Pixels pixels;
+  gsize *counts;
+  gint x, y, channel, value;
+
+  pixels_check (L, 1, &pixels, FALSE);
+  counts = lua_newuserdata (L, 4 * 256 * sizeof (gsize));
+  memset (counts, 0, 4 * 256 * sizeof (gsize));
+  for (y = 0; y < pixels.height; y++)
+    {
+      const guint32 *row = (const guint32 *) (pixels.data + y * pixels.stride);
+      for (x = 0; x < pixels.width; x++)
+	{
+	  guint32 p = row[x];
+	  counts[(p >> 16) & 0xff]++;
+	  counts[256 + ((p >> 8) & 0xff)]++;
+	  counts[512 + (p & 0xff)]++;
+	  counts[768 + (p >> 24)]++;
+	}
+    }
+
+  for (channel = 0; channel < 4; channel++)
+    {
+      lua_createtable (L, 256, 0);
+      for (value = 0; value < 256; value++)
+	{
+	  lua_pushnumber (L, counts[channel * 256 + value]);
+	  lua_rawseti (L, -2, value + 1);
+	}
+    }
+  return 4;
+}
+
+/* Creates buffer sharing the pixel data of the image surface, which
+   is kept alive by the buffer.  The data, stride and height of the
+   surface are queried by '_get_data', '_get_stride' and '_get_height'
+   functions of the surface type.  Lua-side prototype:
+   buffer = core.pixels.buffer(surface) */
+static int
+pixels_buffer (lua_State *L)
+{
+  gpointer surface = NULL;
+  guint8 *(*get_data) (gpointer);
+  int (*get_stride) (gpointer), (*get_height) (gpointer);
+  guint8 *data;
+  int stride, height;
+
+  /* Use the type of the surface record itself. */
+  lua_getfenv (L, 1);
+  luaL_argcheck (L, lua_istable (L, -1), 1, "surface expected");
+  get_data = lgi_gi_load_function (L, -1, "_get_data");
+  get_stride = lgi_gi_load_function (L, -1, "_get_stride");
+  get_height = lgi_gi_load_function (L, -1, "_get_height");
+  luaL_argcheck (L, get_data && get_stride && get_height, 1,
+		 "surface expected");
+  lgi_record_2c (L, 1, &surface, FALSE, FALSE, FALSE, TRUE);
+  luaL_argcheck (L, surface != NULL, 1, "surface expected");
+
+  data = get_data (surface);
+  stride = get_stride (surface);
+  height = get_height (surface);
+  luaL_argcheck (L, data != NULL && stride > 0 && height >= 0, 1,
+		 "surface has no pixel data");
+  lgi_buffer_new_borrowed (L, data, (gsize) stride * height, 1, TRUE);
+  return 1;
+}
+
+static const luaL_Reg pixels_reg[] = {
+  { "fill", pixels_fill },
+  { "blit", pixels_blit },
+  { "to_rgba", pixels_to_rgba },
+  { "from_rgba", pixels_from_rgba },
+  { "histogram", pixels_histogram },
+  { "buffer", pixels_buffer },
+  { NULL, NULL }
+};
+
+void
+lgi_pixels_init (lua_State *L)
+{
+  /* Register 'pixels' API table in main core API table. */
+  lua_newtable (L);
+  luaL_register (L, NULL, pixels_reg);
+  lua_setfield (L, -2, "pixels");
+}
@@ -40,6 +40,10 @@ typedef struct _Record
   /* Store mode of the record. */
   RecordStore store;
 
+  /* Estimated size of owned native memory, accounted by
+     lgi_memory_add(). */
+  gsize memsize;
+
   /* If the record is allocated 'on the stack', its data is
      here. Anonymous union makes sure that data is properly aligned to
      hold (hopefully) any structure. */
@@ -63,6 +67,33 @@ static int record_cache;
    recordproxy(weak) -> parent */
 static int parent_cache;
 
+/* lightuserdata key to cache table containing
+   parent(weak) -> { recordproxy(weak) -> true }, sets of records
+   nested in the parent. */
+static int children_cache;
+
+/* Accounts native memory of the record at narg, if it is owned. */
+static void
+record_account (lua_State *L, Record *record, int narg)
+{
+  if (record->store == RECORD_STORE_ALLOCATED && record->memsize == 0)
+    {
+      lgi_makeabs (L, narg);
+      lua_getfenv (L, narg);
+      record->memsize = lgi_memory_estimate (L, -1, narg, record->addr, TRUE);
+      lua_pop (L, 1);
+      lgi_memory_add (L, record->memsize);
+    }
+}
+
+/* Removes accounting of record's native memory. */
+static void
+record_unaccount (lua_State *L, Record *record)
+{
+  lgi_memory_remove (L, record->memsize);
+  record->memsize = 0;
+}
+
 gpointer
 lgi_record_new (lua_State *L, int count, gboolean alloc)
 {
@@ -83,6 +114,7 @@ lgi_record_new (lua_State *L, int count, gboolean alloc)
   lua_pushlightuserdata (L, &record_mt);
   lua_rawget (L, LUA_REGISTRYINDEX);
   lua_setmetatable (L, -2);
+  record->memsize = 0;
   if (G_LIKELY (!alloc))
     {
       record->addr = record->data;
@@ -120,6 +152,7 @@ lgi_record_new (lua_State *L, int count, gboolean alloc)
 
   /* Remove refrepo table from the stack. */
   lua_remove (L, -2);
+  record_account (L, record, -1);
   return record->addr;
 }
 
@@ -208,7 +241,10 @@ lgi_record_2lua (lua_State *L, gpointer addr, gboolean own, int parent)
       if (own)
 	{
 	  if (record->store == RECORD_STORE_EXTERNAL)
-	    record->store = RECORD_STORE_ALLOCATED;
+	    {
+	      record->store = RECORD_STORE_ALLOCATED;
+	      record_account (L, record, -1);
+	    }
 	  else if (record->store == RECORD_STORE_ALLOCATED)
 	    record_free (L, record, -1);
 	}
@@ -223,6 +259,7 @@ lgi_record_2lua (lua_State *L, gpointer addr, gboolean own, int parent)
   lua_rawget (L, LUA_REGISTRYINDEX);
   lua_setmetatable (L, -2);
   record->addr = addr;
+  record->memsize = 0;
   if (parent != 0)
     {
       /* Store reference to the parent argument into parent reference
@@ -233,6 +270,7 @@ lgi_record_2lua (lua_State *L, gpointer addr, gboolean own, int parent)
       lua_pushvalue (L, parent);
       lua_rawset (L, -3);
       lua_pop (L, 1);
+      lgi_cache_add_dependent (L, &children_cache, parent, -1);
       record->store = RECORD_STORE_NESTED;
     }
   else
@@ -281,6 +319,7 @@ lgi_record_2lua (lua_State *L, gpointer addr, gboolean own, int parent)
      remove also typetable which was present when we were called. */
   lua_replace (L, -4);
   lua_pop (L, 2);
+  record_account (L, record, -1);
 }
 
 /* Checks that given argument is Record userdata and returns pointer
@@ -387,7 +426,10 @@ lgi_record_2c (lua_State *L, int narg, gpointer target, gboolean by_value,
 	      if (refsink_func)
 		refsink_func(record->addr);
 	      else
-		record->store = RECORD_STORE_EXTERNAL;
+		{
+		  record->store = RECORD_STORE_EXTERNAL;
+		  record_unaccount (L, record);
+		}
 	    }
 	  else
 	    g_critical ("attempt to steal record ownership from unowned rec");
@@ -434,8 +476,11 @@ record_gc (lua_State *L)
 	uninit (record->addr);
     }
   else if (record->store == RECORD_STORE_ALLOCATED)
-    /* Free the owned record. */
-    record_free (L, record, 1);
+    {
+      /* Free the owned record. */
+      record_unaccount (L, record);
+      record_free (L, record, 1);
+    }
 
   if (record->store == RECORD_STORE_NESTED)
     {
@@ -445,12 +490,77 @@ record_gc (lua_State *L)
       lua_rawset (L, LUA_REGISTRYINDEX);
     }
 
-  /* Unset the metatable / make the record unusable */
-  lua_pushnil (L);
-  lua_setmetatable (L, 1);
+  /* Make the record unusable, closing it again is harmless. */
+  lgi_udata_release (L, 1);
   return 0;
 }
 
+/* Makes nested records and buffers borrowed from the record at narg
+   unusable, because they point into its memory which is going away. */
+static void
+record_detach (lua_State *L, int narg)
+{
+  lgi_makeabs (L, narg);
+  luaL_checkstack (L, 5, "");
+  lgi_cache_take_dependents (L, &children_cache, narg);
+  if (!lua_isnil (L, -1))
+    {
+      lua_pushlightuserdata (L, &parent_cache);
+      lua_rawget (L, LUA_REGISTRYINDEX);
+      lua_pushnil (L);
+      while (lua_next (L, -3))
+	{
+	  /* Detach records nested in the child too, then make the
+	     child unusable, same as record_gc does, and drop its
+	     reference to the parent. */
+	  lua_pop (L, 1);
+	  record_detach (L, -1);
+	  lgi_udata_release (L, -1);
+	  lua_pushvalue (L, -1);
+	  lua_pushnil (L);
+	  lua_rawset (L, -4);
+	}
+      lua_pop (L, 1);
+    }
+  lua_pop (L, 1);
+  lgi_buffer_detach (L, narg);
+}
+
+/* Releases the record immediately, the proxy is unusable afterwards.
+   Returns true if the argument was record proxy.  Lua-side prototype:
+   res = core.record.release(recordinstance) */
+static int
+record_release (lua_State *L)
+{
+  Record *record = record_check (L, 1);
+  if (record == NULL)
+    return 0;
+
+  /* Remove the proxy from the cache, so that the address is not
+     mapped to the released proxy any more. */
+  lua_settop (L, 1);
+  lua_pushlightuserdata (L, &record_cache);
+  lua_rawget (L, LUA_REGISTRYINDEX);
+  lua_pushlightuserdata (L, record->addr);
+  lua_rawget (L, -2);
+  if (lua_rawequal (L, -1, 1))
+    {
+      lua_pushlightuserdata (L, record->addr);
+      lua_pushnil (L);
+      lua_rawset (L, -4);
+    }
+  lua_settop (L, 1);
+
+  /* Nested records and borrowed buffers must not outlive the
+     memory. */
+  record_detach (L, 1);
+
+  /* Perform the same cleanup as the collector does. */
+  record_gc (L);
+  lua_pushboolean (L, 1);
+  return 1;
+}
+
 static int
 record_tostring (lua_State *L)
 {
@@ -511,6 +621,7 @@ record_len (lua_State *L)
 
 static const struct luaL_Reg record_meta_reg[] = {
   { "__gc", record_gc },
+  { "__close", record_release },
   { "__tostring", record_tostring },
   { "__index", record_access },
   { "__newindex", record_access },
@@ -701,12 +812,18 @@ record_set (lua_State *L)
       if (lua_toboolean (L, 2))
 	{
 	  if (record->store == RECORD_STORE_EXTERNAL)
-	    record->store = RECORD_STORE_ALLOCATED;
+	    {
+	      record->store = RECORD_STORE_ALLOCATED;
+	      record_account (L, record, 1);
+	    }
 	}
       else
 	{
 	  if (record->store == RECORD_STORE_ALLOCATED)
-	    record->store = RECORD_STORE_EXTERNAL;
+	    {
+	      record->store = RECORD_STORE_EXTERNAL;
+	      record_unaccount (L, record);
+	    }
 	}
     }
 
@@ -715,6 +832,7 @@ record_set (lua_State *L)
 
 static const struct luaL_Reg record_api_reg[] = {
   { "new", record_new },
+  { "release", record_release },
   { "query", record_query },
   { "field", record_field },
   { "cast", record_cast },
@@ -753,6 +871,7 @@ lgi_record_init (lua_State *L)
   /* Create caches. */
   lgi_cache_create (L, &record_cache, "v");
   lgi_cache_create (L, &parent_cache, "k");
+  lgi_cache_create (L, &children_cache, "k");
 
   /* Create 'record' API table in main core API table. */
   lua_newtable (L);
@@ -71,6 +71,13 @@ function record.struct_mt:_element(instance, symbol)
 	       }
 	    end
 	 end
+
+	 -- Replace cached raw field with the callback field element,
+	 -- so that cache users see the right category.
+	 local cached = category == '_cbkfield' and rawget(self, '_cached')
+	 if cached and cached[symbol] then
+	    cached[symbol] = { element, category }
+	 end
       end
       return element, category
    end
@@ -79,6 +86,7 @@ function record.struct_mt:_element(instance, symbol)
    if symbol == '_native' then return symbol, '_internal'
    elseif symbol == '_type' then return symbol, '_internal'
    elseif symbol == '_refsink' then return symbol, '_internal'
+   elseif symbol == '_dispose' then return symbol, '_internal'
    end
 
    -- If the record has parent struct, try it there.
@@ -151,6 +159,8 @@ function record.struct_mt:_access_internal(instance, element, ...)
       return core.record.query(instance, 'addr')
    elseif element == '_type' then
       return core.record.query(instance, 'repo')
+   elseif element == '_dispose' then
+      return core.record.release
    end
 end
 
@@ -208,6 +218,15 @@ function record.load(info)
    return record
 end
 
+-- Assigning access handlers invalidates handlers cached by native
+-- instance access.
+function record.struct_mt:__newindex(name, value)
+   rawset(self, name, value)
+   if type(name) == 'string' and name:match('^_access') then
+      core.marshal.access_epoch()
+   end
+end
+
 -- Union metatable is the same as struct one, but has different name
 -- to differentiate unions.
 record.union_mt = record.struct_mt:clone('union')
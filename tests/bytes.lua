@@ -0,0 +1,183 @@
+--[[--------------------------------------------------------------------------
+
+  LGI testsuite, bytes buffer test suite.
+
+  Copyright (c) 2026 lgi contributors
+  Licensed under the MIT license:
+  http://www.opensource.org/licenses/mit-license.php
+
+--]]--------------------------------------------------------------------------
+
+local lgi = require 'lgi'
+local bytes = require 'bytes'
+
+local check = testsuite.check
+local checkv = testsuite.checkv
+
+-- Basic bytes buffer testing
+local buffer = testsuite.group.new('bytes')
+
+function buffer.basic()
+   local buf = bytes.new(4)
+   checkv(#buf, 4, 'number')
+   checkv(buf[1], 0, 'number')
+   buf[2] = 0x141
+   checkv(buf[2], 0x41, 'number')
+   check(buf[5] == nil)
+   check(not pcall(function() buf[5] = 1 end))
+   checkv(tostring(bytes.new('abc')), 'abc', 'string')
+end
+
+function buffer.view()
+   local buf = bytes.new('0123456789')
+   local view = buf:view(3, 4)
+   checkv(#view, 4, 'number')
+   checkv(tostring(view), '2345', 'string')
+   view[1] = ('x'):byte()
+   checkv(tostring(buf), '01x3456789', 'string')
+   local sub = view:view(2)
+   checkv(tostring(sub), '345', 'string')
+   check(not pcall(buf.view, buf, 12))
+   check(not pcall(buf.view, buf, 1, 11))
+
+   -- Views survive their parent's variable and reflect resizing.
+   buf = nil
+   collectgarbage()
+   checkv(tostring(sub), '345', 'string')
+   check(not pcall(view.resize, view, 2))
+end
+
+function buffer.typed()
+   local buf = bytes.new(16)
+   buf:set_uint32_le(1, 0x01020304)
+   checkv(tostring(buf:view(1, 4)), '\4\3\2\1', 'string')
+   checkv(buf:get_uint32_be(1), 0x04030201, 'number')
+   buf:set_int16_be(5, -2)
+   checkv(tostring(buf:view(5, 2)), '\255\254', 'string')
+   checkv(buf:get_int16_be(5), -2, 'number')
+   checkv(buf:get_uint16_be(5), 0xfffe, 'number')
+   buf:set_int8(7, -1)
+   checkv(buf:get_uint8(7), 255, 'number')
+   buf:set_double_le(9, 1.5)
+   checkv(buf:get_double_le(9), 1.5, 'number')
+   buf:set_float(1, -0.25)
+   checkv(buf:get_float(1), -0.25, 'number')
+   buf:set_int64_be(9, -3)
+   checkv(buf:get_int64_be(9), -3, 'number')
+   checkv(buf:get_uint8(16), 0xfd, 'number')
+   check(not pcall(buf.get_uint32, buf, 14))
+   check(not pcall(buf.set_uint8, buf, 0, 1))
+end
+
+function buffer.bulk()
+   local buf = bytes.new(8)
+   buf:fill(0x61)
+   checkv(tostring(buf), 'aaaaaaaa', 'string')
+   buf:fill(0x62, 3, 2)
+   checkv(tostring(buf), 'aabbaaaa', 'string')
+   buf:copy(5, 'xyz')
+   checkv(tostring(buf), 'aabbxyza', 'string')
+   buf:copy(1, buf, 5, 3)
+   checkv(tostring(buf), 'xyzbxyza', 'string')
+   checkv(buf:find('yz'), 2, 'number')
+   checkv(buf:find('yz', 3), 6, 'number')
+   checkv(buf:find(('a'):byte()), 8, 'number')
+   check(buf:find('za', 9) == nil)
+   check(buf:find('q') == nil)
+   checkv(buf:find(bytes.new('bx')), 4, 'number')
+end
+
+function buffer.growable()
+   local buf = bytes.new(0)
+   for i = 1, 1000 do buf:append(i) end
+   checkv(#buf, 1000, 'number')
+   checkv(buf[1000], 1000 % 256, 'number')
+   buf:append('abc')
+   buf:append(buf:view(1001))
+   checkv(tostring(buf:view(1001)), 'abcabc', 'string')
+   local view = buf:view(1001, 3)
+   buf:resize(1002)
+   checkv(#buf, 1002, 'number')
+   check(not pcall(tostring, view))
+   buf:resize(1010)
+   checkv(buf[1003], 0, 'number')
+   checkv(tostring(view), 'ab\0', 'string')
+end
+
+function buffer.marshal()
+   local GLib = lgi.GLib
+   local buf = bytes.new('0123456789')
+   checkv(GLib.compute_checksum_for_data('MD5', buf:view(3, 4)),
+	  GLib.compute_checksum_for_data('MD5', '2345'), 'string')
+
+   -- Empty buffers are marshalled as empty data, not rejected.
+   checkv(GLib.compute_checksum_for_data('MD5', bytes.new('')),
+	  GLib.compute_checksum_for_data('MD5', ''), 'string')
+   checkv(GLib.utf8_strlen(bytes.new(0), -1), 0, 'number')
+   buf:resize(0)
+   checkv(GLib.utf8_strlen(buf, -1), 0, 'number')
+end
+
+function buffer.foreign()
+   local GLib = lgi.GLib
+   local source = GLib.Bytes.new('hello world')
+   local buf = source.buffer
+   checkv(#buf, 11, 'number')
+   checkv(tostring(buf:view(7)), 'world', 'string')
+   check(not pcall(function() buf[1] = 0 end))
+   check(not pcall(buf.fill, buf, 0))
+   check(not pcall(buf.append, buf, 'x'))
+   check(not pcall(bytes.view, source, true))
+
+   -- Read-only buffers are refused where C might write into them.
+   local variant = GLib.Variant('u', 42)
+   check(not pcall(GLib.Variant.store, variant, buf))
+   local target = bytes.new(variant:get_size())
+   GLib.Variant.store(variant, target)
+   checkv(target:get_uint32(1), 42, 'number')
+
+   -- The buffer keeps the data alive.
+   source = nil
+   collectgarbage()
+   checkv(GLib.compute_checksum_for_data('MD5', buf),
+	  GLib.compute_checksum_for_data('MD5', 'hello world'), 'string')
+
+   -- Mapped files are shared as well.
+   local name = os.tmpname()
+   local file = io.open(name, 'wb')
+   file:write('mapped contents')
+   file:close()
+   local mapped = GLib.MappedFile.new(name, false)
+   buf = bytes.view(mapped)
+   checkv(tostring(buf), 'mapped contents', 'string')
+   checkv(buf:find('contents'), 8, 'number')
+   check(not pcall(buf.set_uint8, buf, 1, 0))
+   check(not pcall(bytes.view, mapped, true))
+   mapped, buf = nil
+   collectgarbage()
+   os.remove(name)
+   check(not pcall(bytes.view, {}))
+end
+
+function buffer.adopt()
+   local core = require 'lgi.core'
+   local GLib = lgi.GLib
+   local decode = GLib.base64_decode
+   checkv(decode('aGVsbG8='), 'hello', 'string')
+
+   -- Per-callable mode.
+   decode.buffers = true
+   local buf = decode('aGVsbG8=')
+   check(type(buf) == 'userdata')
+   checkv(tostring(buf), 'hello', 'string')
+   buf[1] = ('j'):byte()
+   checkv(tostring(buf), 'jello', 'string')
+   decode.buffers = false
+   checkv(decode('aGVsbG8='), 'hello', 'string')
+
+   -- Global mode.
+   check(core.marshal.buffers(true) == false)
+   check(type(decode('aGVsbG8=')) == 'userdata')
+   check(core.marshal.buffers(false) == true)
+   checkv(decode('aGVsbG8='), 'hello', 'string')
+end
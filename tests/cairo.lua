@@ -128,6 +128,45 @@ function cairo.matrix_operations()
    checkv(y, -3, 'number')
 end
 
+function cairo.matrix_transform_points()
+   local cairo = lgi.cairo
+   local bytes = require 'bytes'
+   local m = cairo.Matrix.create_translate(2, 3)
+   m:scale(-2, 4)
+
+   local points = { 1, 1, 0, 0, -1, 0.5 }
+   local result = m:transform_points(points)
+   check(result ~= points)
+   for i = 1, #points, 2 do
+      local x, y = m:transform_point(points[i], points[i + 1])
+      checkv(result[i], x, 'number')
+      checkv(result[i + 1], y, 'number')
+   end
+   check(m:transform_points(result, true, true) == result)
+   for i = 1, #points do checkvf(result[i], points[i], 0.0000001) end
+
+   local buf = bytes.new(16 * 3)
+   for i = 1, #points do buf:set_double((i - 1) * 8 + 1, points[i]) end
+   local out = m:transform_points(buf)
+   checkv(#out, #buf, 'number')
+   checkv(out:get_double(1), 0, 'number')
+   checkv(out:get_double(9), 7, 'number')
+   check(m:transform_points(buf:view(17, 16), true) ~= nil)
+   checkv(buf:get_double(17), 2, 'number')
+   checkv(buf:get_double(25), 3, 'number')
+   checkv(buf:get_double(1), 1, 'number')
+
+   check(not pcall(m.transform_points, m, { 1, 2, 3 }))
+   check(not pcall(m.transform_points, m, bytes.new(12)))
+   local singular = cairo.Matrix.create_scale(0, 1)
+   check(not pcall(singular.transform_points, singular, {}, false, true))
+
+   -- Only cairo.Matrix records are accepted as the matrix.
+   local core = require 'lgi.core'
+   check(not pcall(core.cairo.matrix_transform,
+		   core.record.query(m, 'addr'), points))
+end
+
 function cairo.dash()
    local cairo = lgi.cairo
    local surface = cairo.ImageSurface('ARGB32', 100, 100)
@@ -198,6 +237,50 @@ function cairo.path()
    check(i == 6)
 end
 
+function cairo.path_native()
+   local cairo = lgi.cairo
+   local surface = cairo.ImageSurface('ARGB32', 100, 100)
+   local cr = cairo.Context(surface)
+
+   cr:move_to(10, 11)
+   cr:curve_to(1, 2, 3, 4, 5, 6)
+   cr:close_path()
+   cr:line_to(21, 22)
+
+   local function flatten(path)
+      local flat = {}
+      for t, x1, y1, x2, y2, x3, y3 in path:iter() do
+	 flat[#flat + 1] = t
+	 for _, v in ipairs { x1, y1, x2, y2, x3, y3 } do
+	    flat[#flat + 1] = v
+	 end
+      end
+      return flat
+   end
+
+   local expected = { 'MOVE_TO', 10, 11, 'CURVE_TO', 1, 2, 3, 4, 5, 6,
+		      'CLOSE_PATH', 'MOVE_TO', 10, 11, 'LINE_TO', 21, 22 }
+   local flat = flatten(cr:copy_path())
+   checkv(#flat, #expected, 'number')
+   for i = 1, #expected do checkv(flat[i], expected[i], type(expected[i])) end
+
+   -- Round-trip through the flat array constructor.
+   local path = cairo.Path.from_array(flat)
+   checkv(path.num_data, 11, 'number')
+   cr:new_path()
+   cr:append_path(path)
+   flat = flatten(cr:copy_path())
+   for i = 1, #expected do checkv(flat[i], expected[i], type(expected[i])) end
+   checkv(cairo.Path.from_array({}).num_data, 0, 'number')
+   check(not pcall(cairo.Path.from_array, { 'LINE_TO', 1 }))
+   check(not pcall(cairo.Path.from_array, { 'ARC_TO', 1, 2 }))
+
+   -- Only cairo.Path records can be iterated.
+   local core = require 'lgi.core'
+   check(not pcall(core.cairo.path_iter, core.record.query(path, 'addr')))
+   check(not pcall(core.cairo.path_iter, cairo.Matrix.create_identity()))
+end
+
 function cairo.surface_type()
    local cairo = lgi.cairo
    local surface = cairo.ImageSurface('ARGB32', 100, 100)
@@ -496,3 +579,99 @@ function cairo.pattern_reference()
    -- use-after-free if custom refsink would not work correctly.
    cr.source = source
 end
+
+function cairo.image_surface_memory()
+   local core = require 'lgi.core'
+   local cairo = lgi.cairo
+   collectgarbage()
+   collectgarbage()
+   local total = core.memory()
+   local surface = cairo.ImageSurface('ARGB32', 100, 100)
+   check(core.memory() - total >= surface.stride * surface.height)
+   surface = nil
+   collectgarbage()
+   collectgarbage()
+   check(core.memory() == total)
+end
+
+function cairo.image_surface_pixels()
+   local cairo = lgi.cairo
+   local surface = cairo.ImageSurface('ARGB32', 10, 8)
+   local pixels = surface:get_pixels()
+   checkv(pixels.width, 10, 'number')
+   checkv(pixels.height, 8, 'number')
+
+   -- Drawing by cairo is visible through the pixels and vice versa.
+   local cr = cairo.Context(surface)
+   cr:set_source_rgb(1, 0, 0)
+   cr:rectangle(0, 0, 2, 2)
+   cr:fill()
+   checkv(pixels:get(1, 1), 0xffff0000, 'number')
+   pixels:fill_rect(-5, 4, 100, 100, 0x80008000)
+   checkv(pixels:get(9, 7), 0x80008000, 'number')
+   checkv(pixels:get(9, 3), 0, 'number')
+   check(not pcall(pixels.get, pixels, 10, 0))
+
+   -- Conversion to and from unpremultiplied RGBA.
+   local rgba = pixels:to_rgba(0, 0, 2, 1)
+   checkv(tostring(rgba), '\255\0\0\255\255\0\0\255', 'string')
+   rgba = pixels:to_rgba(0, 4, 1, 1)
+   checkv(tostring(rgba), '\0\255\0\128', 'string')
+   pixels:from_rgba(2, 0, 2, 1, '\0\0\255\255\0\0\255\0')
+   checkv(pixels:get(2, 0), 0xff0000ff, 'number')
+   checkv(pixels:get(3, 0), 0, 'number')
+
+   -- Blitting.
+   local source = require('bytes').new(8)
+   source:set_uint32(5, 0xff00ff00)
+   pixels:blit(0, 2, 2, 1, source)
+   checkv(pixels:get(0, 2), 0, 'number')
+   checkv(pixels:get(1, 2), 0xff00ff00, 'number')
+   check(not pcall(pixels.blit, pixels, 9, 0, 2, 1, ('\0'):rep(8)))
+
+   -- Huge values cannot wrap around the bounds checks.
+   local core, huge = require 'lgi.core', 2 ^ 52
+   check(not pcall(pixels.blit, pixels, 0, 0, huge, huge, source))
+   check(not pcall(pixels.blit, pixels, 0, 0, 2, 2, source, huge))
+   check(not pcall(pixels.from_rgba, pixels, 1, 1, huge, huge, source))
+   check(not pcall(core.pixels.fill, pixels.buffer, huge, 0, 0, 1, 1, 0))
+   check(not pcall(core.pixels.fill, pixels.buffer, pixels.stride,
+		   -huge, huge, huge, huge, 0))
+
+   -- Read-only buffers cannot be written.
+   local readonly = lgi.GLib.Bytes.new(('\0'):rep(16)).buffer
+   check(not pcall(core.pixels.fill, readonly, 16, 0, 0, 4, 1, 0))
+   checkv(#core.pixels.to_rgba(readonly, 16, 0, 0, 4, 1), 16, 'number')
+   check(not pcall(core.pixels.buffer, source))
+
+   -- Histogram.
+   local r, g, b, a = pixels:histogram()
+   checkv(#r, 256, 'number')
+   checkv(a[0x81], 40, 'number')
+   checkv(g[0x81], 40, 'number')
+   checkv(r[0x100], 4, 'number')
+
+   -- Pixels keep the surface alive.
+   cr, surface = nil
+   collectgarbage()
+   checkv(pixels:get(9, 7), 0x80008000, 'number')
+   check(not pcall(cairo.ImageSurface('A8', 4, 4).get_pixels,
+		   cairo.ImageSurface('A8', 4, 4)))
+end
+
+function cairo.image_surface_pixels_release()
+   local core = require 'lgi.core'
+   local cairo = lgi.cairo
+   local surface = cairo.ImageSurface('ARGB32', 4, 4)
+   local pixels = surface:get_pixels()
+   pixels:set(1, 1, 0xff00ff00)
+   checkv(pixels:get(1, 1), 0xff00ff00, 'number')
+
+   -- Pixels cannot access memory of released surface.
+   check(core.release(surface) == true)
+   checkv(#pixels.buffer, 0, 'number')
+   check(not pcall(pixels.buffer.get_uint32, pixels.buffer, 1))
+   check(not pcall(pixels.get, pixels, 1, 1))
+   check(not pcall(pixels.fill_rect, pixels, 0, 0, 4, 4, 0))
+   check(not pcall(pixels.to_rgba, pixels))
+end
@@ -138,3 +138,119 @@ function dbus.proxy_get_interface_info()
    -- Just so that we do test something
    assert(interface == interface2)
 end
+
+function dbus.proxy_stubs()
+   local Gio = lgi.Gio
+   local core = require 'lgi.core'
+
+   local stubs = Gio.DBusNodeInfo.compile [[
+<node>
+  <interface name="org.freedesktop.DBus">
+    <method name="NameHasOwner">
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="b"/>
+    </method>
+    <method name="ListNames">
+      <arg direction="out" type="as"/>
+    </method>
+    <method name="GetId">
+      <arg direction="out" type="s"/>
+    </method>
+  </interface>
+</node>]]
+   local DBus = stubs['org.freedesktop.DBus']
+   check(DBus._interface == 'org.freedesktop.DBus')
+   check(DBus.NameHasOwner == nil)
+
+   local bus = Gio.bus_get_sync(Gio.BusType.SESSION)
+   local daemon = DBus.new(bus, 'org.freedesktop.DBus', '/org/freedesktop/DBus')
+   check(type(daemon.NameHasOwner) == 'function')
+   check(type(daemon.async_ListNames) == 'function')
+   check(daemon:NameHasOwner('org.freedesktop.DBus') == true)
+   check(daemon:NameHasOwner('org.example.Nonexistent') == false)
+   local names = daemon:ListNames()
+   check(type(names) == 'table' and names.n == #names and #names > 0)
+   check(type(daemon:GetId()) == 'string')
+
+   local res = Gio.Async.call(function(target)
+				 return target:async_NameHasOwner(
+				    'org.freedesktop.DBus')
+   end)(daemon)
+   check(res == true)
+
+   check(not pcall(daemon.NameHasOwner, daemon, {}))
+   check(not pcall(core.marshal.variant_codec, '('))
+   check(Gio.DBusNodeInfo.compile('<node') == nil)
+
+   -- Methods clashing with stub members do not overwrite them.
+   local Clash = Gio.DBusNodeInfo.compile [[
+<node>
+  <interface name="org.example.Clash">
+    <method name="new"/>
+    <method name="_info"/>
+    <method name="_interface"/>
+  </interface>
+</node>]]['org.example.Clash']
+   check(Clash._interface == 'org.example.Clash')
+   check(Clash._info.name == 'org.example.Clash')
+   local clash = Clash.new(bus, 'org.example.Clash', '/org/example/Clash')
+   check(clash.new ~= Clash.new and type(clash.new) == 'function')
+   check(type(clash._info) == 'function')
+   check(type(clash._interface) == 'function')
+end
+
+function dbus.export()
+   local Gio = lgi.Gio
+
+   local node = Gio.DBusNodeInfo.new_for_xml [[
+<node>
+  <interface name="org.example.Calculator">
+    <method name="Add">
+      <arg direction="in" type="i"/>
+      <arg direction="in" type="i"/>
+      <arg direction="out" type="i"/>
+    </method>
+    <method name="Split">
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="as"/>
+      <arg direction="out" type="u"/>
+    </method>
+    <method name="Fail"/>
+    <method name="Missing"/>
+  </interface>
+</node>]]
+   local info = node.interfaces[1]
+   local service = { calls = 0 }
+   function service:Add(a, b)
+      self.calls = self.calls + 1
+      return a + b
+   end
+   function service:Split(s)
+      local words = {}
+      for word in s:gmatch('%S+') do words[#words + 1] = word end
+      return words, #words
+   end
+   function service:Fail()
+      error('failed on purpose')
+   end
+
+   local bus = Gio.bus_get_sync(Gio.BusType.SESSION)
+   local id = info:export(bus, '/org/example/Calculator', service)
+   check(type(id) == 'number' and id > 0)
+
+   local Calculator = info:compile()
+   local calc = Calculator.new(bus, bus:get_unique_name(),
+			       '/org/example/Calculator')
+   Gio.Async.call(function()
+	 check(calc:async_Add(2, 3) == 5)
+	 local words, count = calc:async_Split('one two three')
+	 check(#words == 3 and words[3] == 'three' and count == 3)
+	 local ok, err = calc:async_Fail()
+	 check(not ok and err.message:match('failed on purpose'))
+	 ok, err = calc:async_Missing()
+	 check(not ok and err)
+   end)()
+   check(service.calls == 1)
+
+   check(bus:unregister_object(id))
+end
@@ -0,0 +1,114 @@
+------------------------------------------------------------------------------
+--
+--  LGI D-Bus call performance test module
+--
+--  Copyright (c) 2026 lgi contributors
+--  Licensed under the MIT license:
+--  http://www.opensource.org/licenses/mit-license.php
+--
+------------------------------------------------------------------------------
+
+-- Expects to be run with session bus available, e.g. under
+-- dbus-run-session.  Compares method calls of the bus daemon made by
+-- building and unpacking variants by hand with compiled proxy stubs,
+-- and throughput of objects exported in this process using generic
+-- register_object() and natively dispatching export().
+
+local lgi = require("lgi")
+local Gio = lgi.Gio
+local GLib = lgi.GLib
+
+local bus = Gio.bus_get_sync(Gio.BusType.SESSION)
+local DBus = Gio.DBusNodeInfo.compile([[
+<node>
+  <interface name="org.freedesktop.DBus">
+    <method name="NameHasOwner">
+      <arg direction="in" type="s"/>
+      <arg direction="out" type="b"/>
+    </method>
+    <method name="ListNames">
+      <arg direction="out" type="as"/>
+    </method>
+  </interface>
+</node>]])['org.freedesktop.DBus']
+local daemon = DBus.new(bus, 'org.freedesktop.DBus', '/org/freedesktop/DBus')
+
+local reply_b, reply_as = GLib.VariantType.new('(b)'),
+   GLib.VariantType.new('(as)')
+local function call(method, args, reply_type)
+   return bus:call_sync('org.freedesktop.DBus', '/org/freedesktop/DBus',
+			'org.freedesktop.DBus', method, args, reply_type,
+			'NONE', -1)
+end
+
+for _, test in ipairs {
+   { 5000, function()
+	local _ = call('NameHasOwner',
+		       GLib.Variant('(s)', { 'org.freedesktop.DBus' }),
+		       reply_b).value[1]
+   end },
+   { 5000, function() daemon:NameHasOwner('org.freedesktop.DBus') end },
+   { 5000, function()
+	local names = call('ListNames', nil, reply_as)[1]
+	for i = 1, #names do local _ = names[i] end
+   end },
+   { 5000, function() daemon:ListNames() end },
+} do
+   local timer = GLib.Timer()
+   for i = 1, test[1] do
+      test[2]()
+   end
+   timer:stop()
+   io.write(string.format('%0.2f', timer:elapsed()))
+   io.write('\t')
+   io.flush()
+end
+print('\n')
+
+-- Server-side throughput.  The same object is exported twice, calls
+-- are issued asynchronously in batches, because replies are
+-- dispatched by the main loop of this process.
+local info = Gio.DBusNodeInfo.new_for_xml([[
+<node>
+  <interface name="org.example.Echo">
+    <method name="Echo">
+      <arg direction="in" type="s"/>
+      <arg direction="in" type="i"/>
+      <arg direction="out" type="s"/>
+      <arg direction="out" type="i"/>
+    </method>
+  </interface>
+</node>]]).interfaces[1]
+
+bus:register_object('/generic', info, function(_, _, _, _, _, params,
+						invocation)
+   invocation:return_value(GLib.Variant('(si)', params.value))
+end)
+info:export(bus, '/native', { Echo = function(_, s, i) return s, i end })
+
+local Echo = info:compile()
+local loop = GLib.MainLoop()
+for _, path in ipairs { '/generic', '/native' } do
+   local echo = Echo.new(bus, bus:get_unique_name(), path)
+   local count, pending = 20000, 0
+   local function done()
+      pending = pending - 1
+      if pending == 0 then loop:quit() end
+   end
+   local timer = GLib.Timer()
+   for i = 1, count, 100 do
+      for j = i, i + 99 do
+	 pending = pending + 1
+	 Gio.Async.start(function()
+	       echo:async_Echo('echo', j)
+	       done()
+	 end)()
+      end
+      loop:run()
+   end
+   timer:stop()
+   io.write(string.format('%s: %0.0f calls/s\t', path,
+			  count / timer:elapsed()))
+   io.flush()
+end
+print('\n')
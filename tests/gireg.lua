@@ -850,6 +850,21 @@ function gireg.flags_out()
    check(#out == 0)
 end
 
+function gireg.enum_flags_index()
+   local R = lgi.Regress
+   check(R.TestEnum[-1] == 'VALUE3')
+   check(R.TestEnum[-1] == 'VALUE3')
+   check(R.test_enum_param('VALUE2') == 'value2')
+
+   -- Decomposed flags are cached, but each lookup yields fresh table.
+   local first = R.TestFlags[5]
+   first.FLAG2 = true
+   local second = R.TestFlags[5]
+   check(first ~= second)
+   check(second.FLAG1 == true and second.FLAG3 == true)
+   check(second.FLAG2 == nil and #second == 0)
+end
+
 function gireg.const()
    local R = lgi.Regress
    checkv(R.INT_CONSTANT, 4422, 'number')
@@ -950,6 +965,53 @@ function gireg.struct_b()
    check(b.nested_a.some_enum == 'VALUE2')
 end
 
+function gireg.struct_release_nested()
+   local core = require 'lgi.core'
+   local R = lgi.Regress
+   local b = R.TestStructB()
+   local a = b.nested_a
+   a.some_int = 42
+   checkv(a.some_int, 42, 'number')
+
+   -- Nested record does not outlive released parent.
+   check(core.release(b) == true)
+   check(not pcall(function() return a.some_int end))
+   check(core.release(a) == false)
+
+   -- Released proxies can still be closed by to-be-closed variables.
+   if _VERSION >= 'Lua 5.4' then
+      local close = load [[
+	 local core, check, b = ...
+	 local a <close> = b.nested_a
+	 local c <close> = b
+	 check(core.release(b) == true)
+      ]]
+      close(core, check, R.TestStructB())
+   end
+end
+
+function gireg.struct_memsize_hook()
+   local core = require 'lgi.core'
+   local R = lgi.Regress
+   local hook
+   R.TestBoxedB._memsize = function(boxed) return hook(boxed) end
+   collectgarbage()
+   collectgarbage()
+   local total = core.memory()
+
+   -- Failing hooks and invalid sizes do not contribute to the estimate.
+   for _, failing in ipairs {
+      function() return -1 end,
+      function() error('memsize failed') end,
+      function() return 'large' end,
+   } do
+      hook = failing
+      local boxed = R.TestBoxedB.new(1, 2)
+      checkv(boxed.some_int8, 1, 'number')
+      check(core.memory() == total)
+   end
+end
+
 function gireg.struct_b_clone()
    local R = lgi.Regress
    local b = R.TestStructB { some_int8 = 21, nested_a =
@@ -1162,6 +1224,50 @@ function gireg.gvalue_strv()
    check(v.value[3] == '3')
 end
 
+function gireg.gvalue_fundamental()
+   local GLib = lgi.GLib
+   local GObject = lgi.GObject
+   local R = lgi.Regress
+   local V = GObject.Value
+
+   checkv(V('gint64', -5).value, -5, 'number')
+   checkv(V('guint64', 5).value, 5, 'number')
+   checkv(V('glong', -6).value, -6, 'number')
+   checkv(V('gboolean', 0).value, true, 'boolean')
+   checkv(V('gfloat', 0.5).value, 0.5, 'number')
+   check(not pcall(V, 'guchar', 256))
+   check(not pcall(V, 'gint', 'string'))
+
+   local v = V(R.TestEnum, 'VALUE2')
+   checkv(v.value, 'VALUE2', 'string')
+   v.value = R.TestEnum.VALUE3
+   checkv(v.value, 'VALUE3', 'string')
+   v = V(R.TestFlags, { 'FLAG1', 'FLAG3' })
+   check(v.value.FLAG1 and v.value.FLAG3 and not v.value.FLAG2)
+   check(not pcall(V, R.TestEnum, 'BOGUS'))
+   check(not pcall(function() v.value = { 'BOGUS' } end))
+
+   local variant = GLib.Variant('s', 'text')
+   v = V('GVariant', variant)
+   checkv(v.value.value, 'text', 'string')
+   v.value = nil
+   check(v.value == nil)
+
+   local date = GLib.Date()
+   date:set_dmy(1, 2, 2010)
+   v = V(GLib.Date, date)
+   checkv(v.value:get_year(), 2010, 'number')
+   check(not pcall(function() v.value = variant end))
+
+   local obj = R.TestObj()
+   v = V(R.TestObj, obj)
+   check(v.value == obj)
+   check(not pcall(function() v.value = variant end))
+
+   v = V('gpointer')
+   check(type(v.value) == 'userdata')
+end
+
 function gireg.obj_create()
    local R = lgi.Regress
    local o = R.TestObj()
@@ -1458,3 +1564,22 @@ function gireg.callback_async()
    collectgarbage()
    check(R.test_callback_thaw_async() == 1)
 end
+
+function gireg.callback_cached_distinct()
+   -- Namespace-level callbacks have no container, but still have to
+   -- get their own callables with their own signatures.
+   local core = require 'lgi.core'
+   local compare_info = core.gi.GLib.CompareFunc
+   local notify_info = core.gi.GLib.DestroyNotify
+   local notified
+   local compare_guard, compare_addr = core.marshal.callback(
+      compare_info, function() return 42 end)
+   local notify_guard, notify_addr = core.marshal.callback(
+      notify_info, function() notified = true end)
+   local compare = core.callable.new(compare_info, compare_addr)
+   local notify = core.callable.new(notify_info, notify_addr)
+   checkv(compare(nil, nil), 42, 'number')
+   check(select('#', notify(nil)) == 0)
+   check(notified)
+   check(compare_guard and notify_guard)
+end
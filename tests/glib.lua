@@ -154,3 +154,34 @@ function glib.coroutine_related_crash()
     end)()
     mainloop:run()
 end
+
+function glib.bytes_memory()
+   local core = require 'lgi.core'
+   local GLib = lgi.GLib
+   collectgarbage()
+   collectgarbage()
+   local total, count = core.memory()
+   local bytes = GLib.Bytes.new(('x'):rep(10000))
+   local new_total, new_count = core.memory()
+   check(new_total - total >= 10000)
+   check(new_count == count + 1)
+   bytes = nil
+   collectgarbage()
+   collectgarbage()
+   check(core.memory() == total)
+end
+
+function glib.bytes_release()
+   local core = require 'lgi.core'
+   local GLib = lgi.GLib
+   collectgarbage()
+   collectgarbage()
+   local total = core.memory()
+   local bytes = GLib.Bytes.new(('x'):rep(10000))
+   check(core.memory() > total)
+   bytes:_dispose()
+   check(core.memory() == total)
+   check(not pcall(function() return bytes:get_size() end))
+   check(core.release(bytes) == false)
+   check(core.release('not a proxy') == false)
+end
@@ -25,6 +25,19 @@ function gobject.env_base()
    check(next(core.object.env(obj)) == nil)
 end
 
+function gobject.plain_marshal()
+   local GObject, Gio = lgi.GObject, lgi.Gio
+   -- Objects without memory hooks are marshalled with their own type,
+   -- both when memory estimate is computed and when it is cached.
+   for _ = 1, 2 do
+      local obj = GObject.Object()
+      check(GObject.Object:is_type_of(obj))
+      local cancellable = Gio.Cancellable.new()
+      check(Gio.Cancellable:is_type_of(cancellable))
+      checkv(cancellable:is_cancelled(), false, 'boolean')
+   end
+end
+
 if lgi.Gtk.Window._method.add then
   function gobject.env_persist()
      local Gtk = lgi.Gtk
@@ -116,6 +129,68 @@ function gobject.subclass_override1()
    check(state == 3)
 end
 
+function gobject.subclass_override_shared()
+   local GObject = lgi.GObject
+   local calls, inits = {}, 0
+
+   -- Several classes overriding the same virtual method share single
+   -- compiled callable, but dispatch to their own targets.
+   local classes = {}
+   for i = 1, 3 do
+      local Derived = GObject.Object:derive('LgiTestOverrideShared' .. i)
+      function Derived:_init()
+	 check(Derived:is_type_of(self))
+	 inits = inits + 1
+      end
+      function Derived:do_constructed()
+	 calls[#calls + 1] = i
+	 check(self.priv ~= nil)
+      end
+      classes[i] = Derived
+   end
+   for i = 1, 3 do
+      for _ = 1, 2 do classes[i]() end
+   end
+   checkv(inits, 6, 'number')
+   checkv(table.concat(calls, ','), '1,1,2,2,3,3', 'string')
+end
+
+function gobject.subclass_override_vfunc()
+   local GObject = lgi.GObject
+   local notified = {}
+   local function derive(name)
+      local Derived = GObject.Object:derive(name)
+      Derived._property.value = GObject.ParamSpecInt(
+	 'value', 'value', 'value', 0, 100, 0, { 'READABLE', 'WRITABLE' })
+      return Derived
+   end
+
+   -- Override installed from main thread.
+   local First = derive('LgiTestOverrideVfunc1')
+   function First:do_notify(pspec)
+      check(First:is_type_of(self))
+      notified[#notified + 1] = 'first:' .. pspec.name
+   end
+
+   -- Override installed from coroutine which stays suspended, so the
+   -- override cannot be dispatched in its thread.
+   local Second = derive('LgiTestOverrideVfunc2')
+   local coro = coroutine.create(function()
+      function Second:do_notify(pspec)
+	 check(Second:is_type_of(self))
+	 notified[#notified + 1] = 'second:' .. pspec.name
+      end
+      coroutine.yield()
+   end)
+   check(coroutine.resume(coro))
+
+   local first, second = First(), Second()
+   first.value = 1
+   second.value = 2
+   checkv(table.concat(notified, ','), 'first:value,second:value', 'string')
+   checkv(coroutine.status(coro), 'suspended', 'string')
+end
+
 function gobject.subclass_override2()
    local GObject = lgi.GObject
    local state = 0
@@ -341,6 +416,37 @@ function gobject.subclass_prop_getset()
    checkv(propval, 'assign', 'string')
 end
 
+function gobject.subclass_prop_dispatch()
+   local GObject = lgi.GObject
+   local function int_property(name)
+      return GObject.ParamSpecInt(name, name, name, 0, 100, 0,
+				  { 'READABLE', 'WRITABLE' })
+   end
+
+   -- Both classes use the same property names, subclass adds its own
+   -- property on top of inherited ones.
+   local First = GObject.Object:derive('LgiTestPropDispatch1')
+   First._property.value = int_property('value')
+   First._property.other_value = int_property('other-value')
+   function First._property_get:value() return 10 end
+   local Second = GObject.Object:derive('LgiTestPropDispatch2')
+   Second._property.value = int_property('value')
+   local Sub = First:derive('LgiTestPropDispatch3')
+   Sub._property.extra = int_property('extra')
+
+   local first, second, sub = First(), Second(), Sub()
+   second.value = 20
+   sub.extra = 30
+   sub.other_value = 40
+   checkv(first.value, 10, 'number')
+   checkv(second.value, 20, 'number')
+   checkv(second.priv.value, 20, 'number')
+   checkv(sub.value, 10, 'number')
+   checkv(sub.extra, 30, 'number')
+   checkv(sub.other_value, 40, 'number')
+   checkv(sub.priv.other_value, 40, 'number')
+end
+
 function gobject.signal_query()
    local GObject = lgi.GObject
    local id = GObject.signal_lookup('notify', GObject.Object)
@@ -352,3 +458,325 @@ function gobject.signal_query()
    check(#query.param_types == 1)
    check(query.param_types[1] == GObject.Type.name(GObject.Type.PARAM))
 end
+
+function gobject.inherited_element_cache()
+   local GObject = lgi.GObject
+   local InitiallyUnowned = GObject.InitiallyUnowned
+   local notify = InitiallyUnowned.notify
+   check(notify ~= nil)
+   check(InitiallyUnowned.notify == notify)
+   local cached = rawget(InitiallyUnowned, '_cached')
+   check(cached and cached.notify[1] == notify)
+   check(cached.notify[3] == GObject.Object)
+
+   -- Members added later to derived classes must stay visible in
+   -- classes derived from them.
+   local Derived = GObject.Object:derive('LgiTestFlatDerived')
+   local Subderived = Derived:derive('LgiTestFlatSubderived')
+   check(Subderived.notify == notify)
+   function Derived:notify() end
+   check(Subderived.notify == Derived.notify)
+
+   -- Replacing members of parent classes after they were flattened
+   -- must be visible in subclasses too.
+   local function replaced() end
+   GObject.Object.notify = replaced
+   check(InitiallyUnowned.notify == replaced)
+   GObject.Object.notify = notify
+   check(InitiallyUnowned.notify == notify)
+end
+
+function gobject.cached_access_dispatch()
+   local GObject = lgi.GObject
+   local Derived = GObject.Object:derive('LgiTestCachedDispatch')
+   local value = 0
+   Derived._attribute = {
+      answer = { get = function(self) return 42 end },
+      value = {
+	 get = function(self) return value end,
+	 set = function(self, new_value) value = new_value end,
+      },
+   }
+   local der = Derived()
+
+   -- Repeat the access, so that both first lookup and cached dispatch
+   -- are exercised.
+   for i = 1, 3 do
+      checkv(der.answer, 42, 'number')
+      check(not pcall(function() der.answer = i end))
+      der.value = i
+      checkv(der.value, i, 'number')
+      check(der.notify == GObject.Object.notify)
+   end
+end
+
+function gobject.signal_emit_repeated()
+   local GObject = lgi.GObject
+   local obj = GObject.Object()
+   local pspec = GObject.ParamSpecInt('lgi-test', 'Nick', 'Blurb', 0, 10, 0,
+				      { 'READABLE' })
+   local count = 0
+   obj.on_notify['lgi-test'] = function(object, param)
+      check(object == obj)
+      check(param.name == 'lgi-test')
+      count = count + 1
+   end
+   for i = 1, 3 do obj.on_notify:emit('lgi-test', pspec) end
+   obj.on_notify:emit('lgi-other', pspec)
+   checkv(count, 3, 'number')
+end
+
+function gobject.property_accessor()
+   local Gio = lgi.Gio
+   local action = Gio.SimpleAction.new_stateful(
+      'lgi-test', nil, lgi.GLib.Variant('i', 1))
+   for i = 1, 3 do
+      checkv(action.name, 'lgi-test', 'string')
+      action.enabled = (i % 2 == 0)
+      checkv(action.enabled, i % 2 == 0, 'boolean')
+      action.state = lgi.GLib.Variant('i', i)
+      checkv(action.state.value, i, 'number')
+   end
+
+   -- Properties of derived classes are accessed through the same
+   -- accessors.
+   local GObject = lgi.GObject
+   local Derived = GObject.Object:derive('LgiTestPropertyAccessor')
+   Derived._property.number = GObject.ParamSpecInt(
+      'number', 'Number', 'Number', 0, 100, 5,
+      { 'READABLE', 'WRITABLE', 'CONSTRUCT' })
+   local der = Derived()
+   checkv(der.number, 5, 'number')
+   for i = 1, 3 do
+      der.number = i
+      checkv(der.number, i, 'number')
+   end
+   check(not pcall(function() der.number = 'string' end))
+end
+
+function gobject.bulk_properties()
+   local GObject = lgi.GObject
+   local Derived = GObject.Object:derive('LgiTestBulkProperties')
+   for _, name in pairs { 'first', 'second' } do
+      Derived._property[name] = GObject.ParamSpecInt(
+	 name, name, name, 0, 100, 0, { 'READABLE', 'WRITABLE' })
+   end
+   local der = Derived()
+   local notified = {}
+   der.on_notify = function(object, pspec)
+      -- All properties are already set when notifications arrive.
+      check(object.first == 1 and object.second == 2)
+      notified[#notified + 1] = pspec.name
+   end
+   der:set_properties { first = 1, second = 2 }
+   checkv(#notified, 2, 'number')
+   local values = der:get_properties { 'first', 'second' }
+   checkv(values.first, 1, 'number')
+   checkv(values.second, 2, 'number')
+   check(not pcall(der.set_properties, der, { first = 'bad' }))
+   check(not pcall(der.set_properties, der, { first = 3, nonexistent = 1 }))
+   check(not pcall(der.get_properties, der, { 'first', 'nonexistent' }))
+   checkv(der.first, 1, 'number')
+
+   -- Attributes are accessed in bulk together with properties.
+   Derived._attribute = {
+      third = { get = function(obj) return obj.priv.third end,
+		set = function(obj, value) obj.priv.third = value end },
+   }
+   der:set_properties { second = 3, third = 'attr' }
+   checkv(der.second, 3, 'number')
+   checkv(der.priv.third, 'attr', 'string')
+   values = der:get_properties { 'second', 'third' }
+   checkv(values.second, 3, 'number')
+   checkv(values.third, 'attr', 'string')
+end
+
+function gobject.construct_properties()
+   local GLib, Gio = lgi.GLib, lgi.Gio
+   for i = 1, 3 do
+      local activated
+      local action = Gio.SimpleAction {
+	 name = 'lgi-test' .. i,
+	 parameter_type = GLib.VariantType('s'),
+	 enabled = false,
+	 state = GLib.Variant('i', i),
+	 on_activate = function(action, param) activated = param.value end,
+      }
+      checkv(action.name, 'lgi-test' .. i, 'string')
+      checkv(action.enabled, false, 'boolean')
+      checkv(action.parameter_type:dup_string(), 's', 'string')
+      checkv(action.state.value, i, 'number')
+      action.enabled = true
+      action:activate(GLib.Variant('s', 'param'))
+      checkv(activated, 'param', 'string')
+   end
+   check(not pcall(Gio.SimpleAction,
+		   { name = 'lgi-test', parameter_type = 1 }))
+
+   -- Property count is validated before anything is allocated.
+   local gtype = Gio.SimpleAction._gtype
+   check(not pcall(core.object.construct, gtype, {}, -1, {}))
+   check(not pcall(core.object.construct, gtype, { name = 'x' }, 0, {}))
+end
+
+function gobject.closure_native_marshal()
+   local GObject = lgi.GObject
+   local obj = GObject.Object()
+   local closure = GObject.Closure(function(b, i, d, s, o, n, ...)
+      check(select('#', ...) == 0)
+      checkv(b, true, 'boolean')
+      checkv(i, -3, 'number')
+      checkv(d, 1.5, 'number')
+      checkv(s, 'text', 'string')
+      check(o == obj)
+      check(n == nil)
+      return s .. i
+   end)
+   local res = GObject.Value('gchararray')
+   closure:invoke(res, {
+		     GObject.Value('gboolean', true),
+		     GObject.Value('gint', -3),
+		     GObject.Value('gdouble', 1.5),
+		     GObject.Value('gchararray', 'text'),
+		     GObject.Value('GObject', obj),
+		     GObject.Value('GObject'),
+		  }, nil)
+   checkv(res.value, 'text-3', 'string')
+
+   -- Values of types which are not marshalled natively are passed
+   -- through their Value marshallers.
+   local variant = lgi.GLib.Variant('i', 7)
+   closure = GObject.Closure(function(v) return v.value end)
+   res = GObject.Value('gint')
+   closure:invoke(res, { GObject.Value('GVariant', variant) }, nil)
+   checkv(res.value, 7, 'number')
+
+   -- Enums are passed and returned symbolically.
+   local Gio = lgi.Gio
+   closure = GObject.Closure(function(file_type)
+      checkv(file_type, 'REGULAR', 'string')
+      return 'DIRECTORY'
+   end)
+   res = GObject.Value(Gio.FileType)
+   closure:invoke(res, { GObject.Value(Gio.FileType, 'REGULAR') }, nil)
+   checkv(res.value, 'DIRECTORY', 'string')
+end
+
+function gobject.toggle_ref_cycles()
+   local GObject = lgi.GObject
+   local Derived = GObject.Object:derive('LgiTestToggleRef1')
+   Derived._property.count = GObject.ParamSpecInt(
+      'count', 'Nick count', 'Blurb count', 0, 100, 0,
+      { 'READABLE', 'WRITABLE' })
+   local proxies = setmetatable({}, { __mode = 'k' })
+
+   -- Objects referencing themselves through their priv tables and
+   -- signal handlers are collected when no longer used.
+   local function create(i)
+      local obj = Derived()
+      obj.priv.self = obj
+      obj.priv.payload = tostring(i):rep(200)
+      obj.on_notify = function() return obj.priv.payload end
+      proxies[obj] = true
+   end
+   create(0)
+   collectgarbage()
+   collectgarbage()
+   local memory = collectgarbage('count')
+   for i = 1, 1000 do create(i) end
+   collectgarbage()
+   collectgarbage()
+   check(next(proxies) == nil)
+   check(collectgarbage('count') < memory + 200)
+
+   -- Objects referenced from C keep their proxy and Lua-side state.
+   local obj = Derived()
+   obj.priv.value = 42
+   obj.on_notify = function() obj.priv.value = obj.priv.value + 1 end
+   local value = GObject.Value(Derived, obj)
+   obj = nil
+   collectgarbage()
+   collectgarbage()
+   obj = value.value
+   checkv(obj.priv.value, 42, 'number')
+   obj.count = 1
+   checkv(obj.priv.value, 43, 'number')
+end
+
+function gobject.release()
+   local core = require 'lgi.core'
+   local GObject = lgi.GObject
+   local disposed = 0
+   local Derived = GObject.Object:derive('LgiTestRelease1')
+   function Derived:do_dispose()
+      disposed = disposed + 1
+      GObject.Object.do_dispose(self)
+   end
+
+   -- Releasing the last reference disposes the object immediately.
+   local obj = Derived()
+   obj.priv.value = 42
+   check(core.release(obj) == true)
+   checkv(disposed, 1, 'number')
+   check(core.release(obj) == false)
+   check(not pcall(function() return obj.priv end))
+
+   -- _dispose is available as a method of every object.
+   obj = Derived()
+   obj:_dispose()
+   checkv(disposed, 2, 'number')
+
+   -- Object still referenced from C stays alive, only the proxy is
+   -- released; a fresh proxy is created for it on the next access.
+   obj = Derived()
+   obj.priv.value = 42
+   local value = GObject.Value(Derived, obj)
+   obj:_dispose()
+   checkv(disposed, 2, 'number')
+   obj = value.value
+   check(obj.priv.value == nil)
+   value, obj = nil
+   collectgarbage()
+   collectgarbage()
+   checkv(disposed, 3, 'number')
+
+   -- Lua 5.4 to-be-closed variables release the object at the end of
+   -- the scope.
+   if _VERSION >= 'Lua 5.4' then
+      local chunk = load([[
+	 local Derived = ...
+	 do local obj <close> = Derived() end
+      ]])
+      chunk(Derived)
+      checkv(disposed, 4, 'number')
+   end
+end
+
+function gobject.cached_access_late()
+   local GObject = lgi.GObject
+   local Derived = GObject.Object:derive('LgiTestCachedAccessLate')
+   Derived._attribute = { answer = { get = function() return 42 end } }
+   local der = Derived()
+   checkv(der.answer, 42, 'number')
+   checkv(der.answer, 42, 'number')
+
+   -- Category handlers defined after the first access are honored.
+   local cached = rawget(Derived, '_cached') or {}
+   rawset(Derived, '_cached', cached)
+   cached.special = { 'element', '_special' }
+   checkv(der.special, 'element', 'string')
+   function Derived:_access_special(instance, element)
+      return element .. '!'
+   end
+   checkv(der.special, 'element!', 'string')
+
+   -- Custom _access overrides cached dispatch.
+   local inherited = Derived._access
+   function Derived:_access(instance, symbol, ...)
+      if symbol == 'answer' then return 'custom' end
+      return inherited(self, instance, symbol, ...)
+   end
+   checkv(der.answer, 'custom', 'string')
+   rawset(Derived, '_access', nil)
+   checkv(der.answer, 42, 'number')
+end
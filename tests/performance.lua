@@ -13,6 +13,27 @@ local cairo = lgi.cairo
 local Gtk = lgi.Gtk
 local GLib = lgi.GLib
 
+-- Startup latency: first use of 50 Gtk.Widget methods.  Methods are
+-- picked from the end of the method list, which used to be the worst
+-- case for on-demand symbol lookup.
+do
+   local infos, names = require('lgi.core').gi.Gtk.Widget.methods, {}
+   for i = #infos, 1, -1 do
+      local flags = infos[i].flags
+      if not flags.is_getter and not flags.is_setter then
+	 names[#names + 1] = infos[i].name
+	 if #names == 50 then break end
+      end
+   end
+   local timer = GLib.Timer()
+   for i = 1, #names do
+      local _ = Gtk.Widget[names[i]]
+   end
+   timer:stop()
+   print(string.format('first use of %d methods: %0.4f', #names,
+		       timer:elapsed()))
+end
+
 local width, height = 200, 200
 local surf = cairo.ImageSurface('ARGB32', width, height)
 local cr = cairo.Context(surf)
@@ -28,6 +49,7 @@ for _, test in ipairs {
    { 10000, function() w:set_title('title') end },
    { 10000, function() Gtk.Window.set_title(w, 'title') end },
    { 10000, function() w.title = 'title' end },
+   { 10000, function() local _ = w.title end },
 } do
    local results = {}
    local timer = GLib.Timer()
@@ -108,6 +108,7 @@ local testpath = arg[0]:sub(1, arg[0]:find('[^%/\\]+$') - 1):gsub('[/\\]$', '')
 for _, sourcefile in ipairs {
    'gireg.lua',
    'marshal.lua',
+   'bytes.lua',
    'corocbk.lua',
    'record.lua',
    'gobject.lua',
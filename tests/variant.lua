@@ -146,6 +146,9 @@ function variant.newv_badtype()
    check(not pcall(V.new, '*'))
    check(not pcall(V.new, '?'))
    check(not pcall(V.new, 'ii'))
+   check(not pcall(V.new, 'ai', { n = -1 }))
+   check(not pcall(V.new, 'ai', { n = 1e300 }))
+   check(not pcall(V.new, 'as', { n = -1 }))
 end
 
 function variant.value_simple()
@@ -159,6 +162,7 @@ function variant.value_simple()
    check(V('q', 15).value == 15)
    check(V('t', 16).value == 16)
    check(V('s', 'I').value == 'I')
+   check(V('h', 3):get_handle() == 3)
    check(V('o', '/o/p').value == '/o/p')
    check(V('g', '(ii)').value == '(ii)')
    v = V('i', 1)
@@ -173,6 +177,8 @@ function variant.value_container()
    local V, v = GLib.Variant
    check(V('mi', 1).value == 1)
    check(V('mi', nil).value == nil)
+   check(V('mb', true).value == true)
+   check(V('mb', false).value == nil)
    local r
    r = V('{sd}', {'one', 1}).value
    check(type(r) == 'table' and #r == 2 and r[1] == 'one' and r[2] == 1)
@@ -272,3 +278,115 @@ function variant.bytestring_embedded_null()
     local v = Variant('ay', value)
     assert(v.value == value)
 end
+
+function variant.newv_fixed_array()
+   local V, v = GLib.Variant
+   v = V('ai', { 1, -2, 3 })
+   check(v.type == 'ai' and #v == 3 and v[2] == -2)
+   v = V('ad', { 0.5, n = 1 })
+   check(#v == 1 and v[1] == 0.5)
+   v = V('aq', {})
+   check(#v == 0)
+   v = V('ay', { 104, 105 })
+   check(v.value == 'hi')
+   v = V('ay', require('bytes').new('buffer'))
+   check(v.value == 'buffer')
+   v = V('(yax)', { 1, { 2, 3 } })
+   check(v[2][2] == 3)
+   check(not pcall(V.new, 'ay', { 256 }))
+   check(not pcall(V.new, 'au', { -1 }))
+   check(not pcall(V.new, 'ai', { 1, 'x' }))
+   check(not pcall(V.new, 'an', { 1, nil, n = 2 }))
+end
+
+function variant.newv_badvalue()
+   local V = GLib.Variant
+   check(not pcall(V.new, 'o', 'not a path'))
+   check(not pcall(V.new, 'g', '{'))
+   check(not pcall(V.new, 's', {}))
+   check(not pcall(V.new, 'v', 'string'))
+   check(not pcall(V.new, '(is)', { 1 }))
+   check(not pcall(V.new, 'a{si}', { one = 'two' }))
+   check(not pcall(V.new, 'a{is}', 'three'))
+end
+
+function variant.unpack()
+   local V, r = GLib.Variant
+   check(V('i', 42):unpack() == 42)
+   check(V('v', V('s', 'inner')):unpack() == 'inner')
+   check(V('ms', nil):unpack() == nil)
+   r = V('ai', { 1, 2, 3 }):unpack()
+   check(type(r) == 'table' and r.n == 3 and r[1] == 1 and r[3] == 3)
+   r = V('ad', { 0.25, 4 }):unpack()
+   check(r[1] == 0.25 and r[2] == 4)
+   r = V('aas', { { 'a', 'b' }, {} }):unpack()
+   check(r.n == 2 and r[1][2] == 'b' and r[2].n == 0)
+   r = V('a{sv}', { one = V('i', 1), list = V('as', { 'x' }) }):unpack()
+   check(r.one == 1 and r.list[1] == 'x')
+   r = V('(a{is}ay)', { { [2] = 'two' }, 'bytes' }):unpack()
+   check(r.n == 2 and r[1][2] == 'two' and r[2] == 'bytes')
+end
+
+function variant.dictionary_large()
+   local V = GLib.Variant
+   local source = {}
+   for i = 1, 1000 do source['key' .. i] = V('i', i) end
+   local v = V('a{sv}', source)
+   check(#v == 1000)
+   check(v.value.key500 == 500)
+   local count = 0
+   for key, value in v:pairs() do
+      check(value.value == source[key].value)
+      count = count + 1
+   end
+   check(count == 1000)
+   local unpacked = v:unpack()
+   for i = 1, 1000 do check(unpacked['key' .. i] == i) end
+end
+
+function variant.map_file()
+   local V = GLib.Variant
+   local function store(v)
+      local name = os.tmpname()
+      local file = io.open(name, 'wb')
+      file:write(tostring(v.data))
+      file:close()
+      return name
+   end
+
+   -- Unsorted document.
+   local doc = V('a{sv}', {
+		    list = V('aa{si}', { { alpha = 1 }, { beta = 2 } }),
+		    name = V('s', 'doc'),
+		    pair = V('(ii)', { 3, 4 }),
+		 })
+   local name = store(doc)
+   local v = V.map_file(name, 'a{sv}')
+   check(v:at('name') == 'doc')
+   check(v:at('list', 2, 'beta') == 2)
+   check(v:at('list', 1).alpha == 1)
+   check(v:at('pair', 2) == 4)
+   check(v:at('list', 3) == nil)
+   check(v:at('missing') == nil)
+   check(v:at('name', 1) == nil)
+   check(v:at().name == 'doc')
+   check(not pcall(v.at, v, 'list', 'x'))
+   v = nil
+   collectgarbage()
+   os.remove(name)
+
+   -- Sorted dictionary searched by bisection.
+   local builder = GLib.VariantBuilder.new(GLib.VariantType.new('a{si}'))
+   for i = 1, 100 do
+      builder:add_value(V('{si}', { ('k%03d'):format(i), i }))
+   end
+   name = store(builder:_end())
+   v = V.map_file(name, 'a{si}', true)
+   for i = 1, 100 do check(v:at(('k%03d'):format(i)) == i) end
+   check(v:at('k000') == nil)
+   check(v:at('zzz') == nil)
+   v = nil
+   collectgarbage()
+   os.remove(name)
+   check(not V.map_file(name, 'i'))
+end